@@ -1,5 +1,4 @@
 cmake -S . ^
 -B build ^
 -DUSE_VCPKG=TRUE ^
--DVCPKG_TOOLCHAIN_FILE=vcpkg/scripts/buildsystems/vcpkg.cmake ^
--DYIN_YANG_USE_SIMD=TRUE
\ No newline at end of file
+-DVCPKG_TOOLCHAIN_FILE=vcpkg/scripts/buildsystems/vcpkg.cmake
\ No newline at end of file
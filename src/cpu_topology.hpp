@@ -0,0 +1,241 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+// logical cpu (hardware thread) as seen by the os
+struct cpu_info_t {
+	int id{};
+	int core{}; // index into cpu_topology_t::cores
+	int node{}; // numa node
+	int smt_index{}; // 0 for the first hardware thread of the core
+};
+
+// cpus the process is allowed to run on, grouped into physical cores & numa nodes
+// linux: read from sysfs & restricted by the process affinity mask
+// elsewhere (or if sysfs is unavailable) every logical cpu is a separate core on a single node, pinning is not supported
+struct cpu_topology_t {
+	// "0-3,8,10-11" -> 0 1 2 3 8 10 11
+	static std::vector<int> parse_cpu_list(const std::string& list) {
+		std::vector<int> cpus;
+		size_t pos = 0;
+		while (pos < list.size()) {
+			size_t end = list.find(',', pos);
+			if (end == std::string::npos) {
+				end = list.size();
+			}
+
+			const std::string range = list.substr(pos, end - pos);
+			const size_t dash = range.find('-');
+			try {
+				const int first = std::stoi(range.substr(0, dash));
+				const int last = dash != std::string::npos ? std::stoi(range.substr(dash + 1)) : first;
+				for (int cpu = first; cpu <= last; cpu++) {
+					cpus.push_back(cpu);
+				}
+			} catch (...) {
+				// whitespace, newline or garbage, skip
+			}
+			pos = end + 1;
+		}
+		return cpus;
+	}
+
+	static bool read_line(const std::string& path, std::string& line) {
+		std::ifstream file(path);
+		return file && std::getline(file, line);
+	}
+
+	static bool read_int(const std::string& path, int& value) {
+		std::string line;
+		if (!read_line(path, line)) {
+			return false;
+		}
+		try {
+			value = std::stoi(line);
+		} catch (...) {
+			return false;
+		}
+		return true;
+	}
+
+	static cpu_topology_t detect() {
+		cpu_topology_t topology;
+#ifdef __linux__
+		if (topology.detect_sysfs()) {
+			return topology;
+		}
+		topology = {};
+#endif
+		const int count = std::max(1u, std::thread::hardware_concurrency());
+		for (int i = 0; i < count; i++) {
+			topology.cpus.push_back({.id = i, .core = i});
+			topology.cores.push_back({i});
+		}
+		topology.node_count = 1;
+		return topology;
+	}
+
+#ifdef __linux__
+	bool detect_sysfs() {
+		const std::string cpu_root = "/sys/devices/system/cpu/";
+		const std::string node_root = "/sys/devices/system/node/";
+
+		std::string online;
+		if (!read_line(cpu_root + "online", online)) {
+			return false;
+		}
+
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		const bool has_affinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+		std::vector<int> ids;
+		for (int id : parse_cpu_list(online)) {
+			if (!has_affinity || (id < CPU_SETSIZE && CPU_ISSET(id, &allowed))) {
+				ids.push_back(id);
+			}
+		}
+		if (ids.empty()) {
+			return false;
+		}
+
+		// cpu -> node, missing node directory means no numa
+		std::vector<int> cpu_node(ids.back() + 1, 0);
+		std::string node_online;
+		node_count = 1;
+		if (read_line(node_root + "online", node_online)) {
+			for (int node : parse_cpu_list(node_online)) {
+				std::string cpulist;
+				if (!read_line(node_root + "node" + std::to_string(node) + "/cpulist", cpulist)) {
+					continue;
+				}
+				for (int cpu : parse_cpu_list(cpulist)) {
+					if (cpu < (int)cpu_node.size()) {
+						cpu_node[cpu] = node;
+					}
+				}
+				node_count = std::max(node_count, node + 1);
+			}
+		}
+
+		// core is identified by (package, core_id), core_id alone repeats across packages
+		std::vector<std::pair<int, int>> core_keys;
+		for (int id : ids) {
+			const std::string topology_dir = cpu_root + "cpu" + std::to_string(id) + "/topology/";
+			int package = 0;
+			int core_id = id;
+			read_int(topology_dir + "physical_package_id", package);
+			read_int(topology_dir + "core_id", core_id);
+
+			const std::pair<int, int> key{package, core_id};
+			auto it = std::find(core_keys.begin(), core_keys.end(), key);
+			const int core = it - core_keys.begin();
+			if (it == core_keys.end()) {
+				core_keys.push_back(key);
+				cores.push_back({});
+			}
+
+			cpus.push_back({.id = id, .core = core, .node = cpu_node[id], .smt_index = (int)cores[core].size()});
+			cores[core].push_back(id);
+		}
+		return true;
+	}
+#endif
+
+	int logical_count() const {
+		return cpus.size();
+	}
+
+	int core_count() const {
+		return cores.size();
+	}
+
+	// master keeps the first core for itself (if there is more than one), one worker per remaining core
+	// use_smt: one worker per hardware thread instead
+	int default_worker_count(bool use_smt, bool reserve_master_core) const {
+		const int reserved = reserve_master_core && core_count() > 1 ? 1 : 0;
+		const int reserved_threads = reserved ? cores[0].size() : 0;
+		return std::max(1, use_smt ? logical_count() - reserved_threads : core_count() - reserved);
+	}
+
+	// hardware threads of the master core
+	std::vector<int> master_cpus() const {
+		return cores.empty() ? std::vector<int>{} : cores[0];
+	}
+
+	// cpu for every worker: first hardware thread of every core node by node (neighbouring workers share the cache),
+	// then the remaining SMT siblings, wraps around if there are more workers than cpus
+	std::vector<int> worker_cpus(int count, bool reserve_master_core) const {
+		const bool reserve = reserve_master_core && core_count() > 1;
+
+		std::vector<const cpu_info_t*> order;
+		for (auto& cpu : cpus) {
+			if (!reserve || cpu.core != 0) {
+				order.push_back(&cpu);
+			}
+		}
+		std::stable_sort(order.begin(), order.end(), [] (const cpu_info_t* a, const cpu_info_t* b) {
+			if (a->smt_index != b->smt_index) {
+				return a->smt_index < b->smt_index;
+			}
+			return a->node < b->node;
+		});
+
+		std::vector<int> result;
+		for (int i = 0; i < count && !order.empty(); i++) {
+			result.push_back(order[i % order.size()]->id);
+		}
+		return result;
+	}
+
+	std::vector<cpu_info_t> cpus;
+	std::vector<std::vector<int>> cores; // logical cpus of every physical core
+	int node_count{};
+};
+
+// cpus the calling thread is allowed to run on, empty if unknown
+inline std::vector<int> current_thread_cpus() {
+	std::vector<int> cpus;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &set)) {
+				cpus.push_back(cpu);
+			}
+		}
+	}
+#endif
+	return cpus;
+}
+
+// restricts calling thread to the given cpus (pass the result of current_thread_cpus() to restore previous affinity)
+inline bool pin_current_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+	if (cpus.empty()) {
+		return false;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus) {
+		if (cpu >= 0 && cpu < CPU_SETSIZE) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpus;
+	return false;
+#endif
+}
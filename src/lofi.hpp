@@ -1,5 +1,6 @@
 #pragma once
 
+#include "simd.hpp"
 #include "utils.hpp"
 
 // ops must have the following ops:
@@ -7,51 +8,146 @@
 // - uint32_t hash(const item_t&)
 // - bool equals(uint32_t, uint32_t)
 // - bool equals(uint32_t, const item_t&)
+// ops can optionally have:
+// - void prefetch(uint32_t) : used by get_many to prefetch item data before equals is called
 
-// hashtable can store 2^20 entries at max
-inline constexpr int lofi_max_buckets = 1 << 20;
+// count of keys processed by one get_many pipeline pass
+inline constexpr uint32_t lofi_get_many_batch = 32;
+
+inline void lofi_prefetch(const void* ptr) {
+	_mm_prefetch((const char*)ptr, _MM_HINT_T0);
+}
 
 // unsafe bitfield implementation (yes we are doing compilers job here)
 // head - head of the list of items inserted in the current bucket
-struct lofi_bucket_data_t {
-	lofi_bucket_data_t() = default;
+// hash - the most significant bits of the hash (fingerprint), whatever is left after head and used bit (or generation)
+// (msb) hash(word_bits - head_bits - 1) | used(1) | head(head_bits) (lsb)
+// generation - if gen_bits != 0 used bit is replaced with generation in which bucket was filled (0 - never used):
+// (msb) generation(gen_bits) | hash(word_bits - head_bits - gen_bits) | head(head_bits) (lsb)
+template<class __word_t, int __head_bits, int __gen_bits = 0>
+struct lofi_basic_bucket_data_t {
+	using word_t = __word_t;
+
+	static constexpr int word_bits = sizeof(word_t) * 8;
+	static constexpr int head_bits = __head_bits;
+	static constexpr int gen_bits = __gen_bits;
+	static constexpr int used_bits = gen_bits == 0 ? 1 : 0;
+	static constexpr int hash_bits = word_bits - head_bits - gen_bits - used_bits;
+
+	static_assert(word_bits >= 32, "word must be able to hold at least 32 bits");
+	static_assert(head_bits > 0 && head_bits <= 32, "head must fit into uint32_t");
+	static_assert(gen_bits >= 0 && gen_bits < 32 && word_bits - gen_bits >= 32, "generation must leave at least 32 bits for hash & head");
+	static_assert(hash_bits > 0, "no bits left for hash");
 
-	lofi_bucket_data_t(uint32_t _data) : data{_data} {}
+	static constexpr int gen_shift = word_bits - gen_bits;
+	static constexpr word_t used_mask = (word_t)used_bits << head_bits;
+	static constexpr word_t head_mask = ((word_t)1 << head_bits) - 1;
+	static constexpr word_t gen_mask = gen_bits == 0 ? 0 : ~(word_t)0 << gen_shift;
+	static constexpr word_t hash_mask = ~(gen_mask | used_mask | head_mask);
 
-	lofi_bucket_data_t(uint32_t _hash, uint32_t _head) {
-		pack(_hash, _head);
+	lofi_basic_bucket_data_t() = default;
+
+	lofi_basic_bucket_data_t(word_t _data) : data{_data} {}
+
+	lofi_basic_bucket_data_t(uint32_t _hash, uint32_t _head, uint32_t _generation = 0) {
+		pack(_hash, _head, _generation);
 	}
 
-	void pack(uint32_t _hash, uint32_t _head) {
-		data = 0x00100000;
+	// aligns msb of the hash with msb of the hash field
+	static word_t spread_hash(uint32_t hash) {
+		return (word_t)hash << (word_bits - gen_bits - 32);
+	}
+
+	void pack(uint32_t _hash, uint32_t _head, uint32_t _generation = 0) {
+		data = used_mask;
 		data |= _head;
-		data |= _hash & 0xFFE00000;
+		data |= spread_hash(_hash) & hash_mask;
+		if constexpr (gen_bits != 0) {
+			assert(_generation != 0);
+			data |= (word_t)_generation << gen_shift;
+		}
 	}
 
+	// bucket was used at least once
 	bool used() const {
-		return data & 0x00100000;
+		if constexpr (gen_bits != 0) {
+			return data & gen_mask;
+		} else {
+			return data & used_mask;
+		}
+	}
+
+	// bucket is used in the current generation
+	bool live(uint32_t _generation) const {
+		if constexpr (gen_bits != 0) {
+			return generation() == _generation;
+		} else {
+			return used();
+		}
+	}
+
+	uint32_t generation() const {
+		if constexpr (gen_bits != 0) {
+			return data >> gen_shift;
+		} else {
+			return 0;
+		}
 	}
 
 	uint32_t head() const {
-		return data & 0xFFFFF;
+		return data & head_mask;
+	}
+
+	void set_head(uint32_t _head) {
+		data = (data & ~head_mask) | _head;
 	}
 	
 	bool hash_equals(uint32_t h) const {
-		return (data & 0xFFE00000) == (h & 0xFFE00000);
+		return (data & hash_mask) == (spread_hash(h) & hash_mask);
+	}
+
+	word_t data{};
+};
+
+// (msb) hash(11) | used(1)| head(20) (lsb)
+using lofi_bucket_data_t = lofi_basic_bucket_data_t<uint32_t, 20>;
+
+// (msb) hash(31) | used(1)| head(32) (lsb)
+using lofi_wide_bucket_data_t = lofi_basic_bucket_data_t<uint64_t, 32>;
+
+// (msb) generation(8) | hash(24) | head(32) (lsb)
+using lofi_generation_bucket_data_t = lofi_basic_bucket_data_t<uint64_t, 32, 8>;
+
+// count tagged with generation, count left from any previous generation is treated as zero
+// the whole struct is updated with a single CAS so the first increment of a generation resets the count
+struct alignas(8) lofi_generation_count_t {
+	operator uint32_t() const {
+		return value;
 	}
 
-	uint32_t data{}; // (msb) hash(11) | used(1)| head(20) (lsb)
+	uint32_t value{};
+	uint32_t generation{};
 };
 
-struct lofi_bucket_t {
+template<class __data_t, class __count_t = uint32_t>
+struct lofi_basic_bucket_t {
+	using data_t = __data_t;
+	using count_t = __count_t;
+
 	bool used() const { return data.used(); }
 	uint32_t head() const { return data.head(); }
 
-	lofi_bucket_data_t data{}; // atomic, managed via std::atomic_ref in hashtable
-	uint32_t count{}; // atomic, managed via std::atomic_ref in hashtable
+	data_t data{}; // atomic, managed via std::atomic_ref in hashtable
+	count_t count{}; // atomic, managed via std::atomic_ref in hashtable
 };
 
+using lofi_bucket_t = lofi_basic_bucket_t<lofi_bucket_data_t>;
+using lofi_wide_bucket_t = lofi_basic_bucket_t<lofi_wide_bucket_data_t>;
+using lofi_generation_bucket_t = lofi_basic_bucket_t<lofi_generation_bucket_data_t, lofi_generation_count_t>;
+
 static_assert(sizeof(lofi_bucket_t) == sizeof(uint64_t), "sizeof lofi_bucket_t must be equal to uint64_t");
+static_assert(sizeof(lofi_wide_bucket_t) == 2 * sizeof(uint64_t), "sizeof lofi_wide_bucket_t must be equal to two uint64_t");
+static_assert(sizeof(lofi_generation_bucket_t) == 2 * sizeof(uint64_t), "sizeof lofi_generation_bucket_t must be equal to two uint64_t");
 
 // TODO : remove next
 // true scans value is scans + 1 (after have been extracted from bit field)
@@ -106,6 +202,48 @@ struct lofi_insertion_t {
 
 inline constexpr lofi_insertion_t lofi_failed_insertion{};
 
+// same as lofi_insertion_t but without packing, bucket index and scans can take full 32 bits
+struct lofi_wide_insertion_t {
+	enum {
+		new_bucket_flag = lofi_insertion_t::new_bucket_flag,
+		inserted_flag = lofi_insertion_t::inserted_flag,
+	};
+
+	lofi_wide_insertion_t() = default;
+
+	lofi_wide_insertion_t(uint32_t bucket, uint32_t next, uint32_t scans, uint32_t flags)
+		: _bucket{bucket}
+		, _next{next}
+		, _scans{scans}
+		, _flags{flags}
+	{}
+
+	uint32_t bucket() const {
+		return _bucket;
+	}
+
+	uint32_t next() const {
+		return _next;
+	}
+
+	uint32_t scans() const {
+		return _scans;
+	}
+
+	bool new_bucket() const {
+		return _flags & new_bucket_flag;
+	}
+
+	bool inserted() const {
+		return _flags & inserted_flag;
+	}
+
+	uint32_t _bucket{};
+	uint32_t _next{};
+	uint32_t _scans{};
+	uint32_t _flags{};
+};
+
 // TODO : remove lofi_get_result_t
 // scans - count of scans made to search for an element
 // true scans value is scans + 1 (after have been extracted from bit field)
@@ -147,7 +285,8 @@ struct lofi_get_result_t {
 
 inline constexpr lofi_get_result_t lofi_failed_get{};
 
-struct lofi_search_result_t {
+template<class bucket_t>
+struct lofi_basic_search_result_t {
 	uint32_t head() const {
 		return bucket.head();
 	}
@@ -160,11 +299,73 @@ struct lofi_search_result_t {
 		return bucket.used();
 	}
 
-	lofi_bucket_t bucket{};
+	bucket_t bucket{};
 	uint32_t bucket_index{};
 	uint32_t scans{};
 };
 
+using lofi_search_result_t = lofi_basic_search_result_t<lofi_bucket_t>;
+using lofi_wide_search_result_t = lofi_basic_search_result_t<lofi_wide_bucket_t>;
+using lofi_generation_search_result_t = lofi_basic_search_result_t<lofi_generation_bucket_t>;
+
+// layout defines bucket and insertion representation, i.e. how much items table can hold and how much memory it takes
+// compact layout: 8 byte bucket, 11 bit fingerprint, up to 2^20 buckets & items
+struct lofi_compact_layout_t {
+	using bucket_data_t = lofi_bucket_data_t;
+	using bucket_t = lofi_bucket_t;
+	using insertion_t = lofi_insertion_t;
+	using search_result_t = lofi_search_result_t;
+
+	static constexpr const char* name = "compact";
+	static constexpr uint32_t max_buckets = 1u << 20;
+};
+
+// wide layout: 16 byte bucket (8 byte data + count + padding), 31 bit fingerprint, up to 2^31 buckets & items
+struct lofi_wide_layout_t {
+	using bucket_data_t = lofi_wide_bucket_data_t;
+	using bucket_t = lofi_wide_bucket_t;
+	using insertion_t = lofi_wide_insertion_t;
+	using search_result_t = lofi_wide_search_result_t;
+
+	static constexpr const char* name = "wide";
+	static constexpr uint32_t max_buckets = 1u << 31;
+};
+
+// generation layout: wide layout with 8 bit generation in place of used bit, 24 bit fingerprint, 16 byte bucket
+// table can be invalidated in O(1) by advancing its generation, full clear is required once in 255 generations
+struct lofi_generation_layout_t {
+	using bucket_data_t = lofi_generation_bucket_data_t;
+	using bucket_t = lofi_generation_bucket_t;
+	using insertion_t = lofi_wide_insertion_t;
+	using search_result_t = lofi_generation_search_result_t;
+
+	static constexpr const char* name = "generation";
+	static constexpr uint32_t max_buckets = 1u << 31;
+};
+
+// compact hashtable can store 2^20 entries at max
+inline constexpr int lofi_max_buckets = lofi_compact_layout_t::max_buckets;
+
+// probing policy defines how far lookups scan
+// linear probing: lookups scan until the first empty bucket
+struct lofi_linear_probing_t {
+	static constexpr const char* name = "linear";
+	static constexpr bool bounded = false;
+};
+
+// bounded probing: linear probing + the longest probe sequence started from every home bucket is tracked (atomic max in put),
+// lookups never scan further than that, so misses in clustered regions end early instead of running until an empty bucket
+// bounds live in an external array of lofi_probe_bound_t (one per bucket), tagged with table generation
+struct lofi_bounded_probing_t {
+	static constexpr const char* name = "bounded";
+	static constexpr bool bounded = true;
+};
+
+// (msb) generation(8) | bound(8) (lsb), bound of 255 means 'unknown', scan whole table
+using lofi_probe_bound_t = uint16_t;
+
+inline constexpr uint32_t lofi_max_probe_bound = 0xFF;
+
 // list stored in memory as array of 'pointers' list[curr_item] = next_item_after_curr_item
 struct lofi_flat_list_walker_t {
 	uint32_t get() const {
@@ -209,21 +410,42 @@ inline int lofi_flat_list_size(const uint32_t* flat_list, uint32_t flat_size, ui
 }
 
 // very low-level hashtable interface, all memory management burden is external to this tiny utility
-struct lofi_hashtable_t {
-	lofi_hashtable_t() = default;
-	lofi_hashtable_t(lofi_bucket_t* _buckets, uint32_t _bucket_count, uint32_t* _next_item, uint32_t _item_count) {
-		reset(_buckets, _bucket_count, _next_item, _item_count);
+// layout_t - bucket layout, see lofi_compact_layout_t & lofi_wide_layout_t
+// probing_t - probing policy, see lofi_linear_probing_t & lofi_bounded_probing_t
+template<class __layout_t, class __probing_t = lofi_linear_probing_t>
+struct lofi_basic_hashtable_t {
+	using layout_t = __layout_t;
+	using probing_t = __probing_t;
+	using bucket_data_t = typename layout_t::bucket_data_t;
+	using bucket_t = typename layout_t::bucket_t;
+	using insertion_t = typename layout_t::insertion_t;
+	using search_result_t = typename layout_t::search_result_t;
+
+	static constexpr uint32_t max_buckets = layout_t::max_buckets;
+	static constexpr bool has_generations = bucket_data_t::gen_bits != 0;
+	static constexpr uint32_t max_generation = ((uint64_t)1 << bucket_data_t::gen_bits) - 1;
+	static constexpr bool has_probe_bounds = probing_t::bounded;
+
+	static_assert(max_generation <= 0xFF, "probe bounds store 8 bit generation");
+
+	lofi_basic_hashtable_t() = default;
+	lofi_basic_hashtable_t(bucket_t* _buckets, uint32_t _bucket_count, uint32_t* _next_item, uint32_t _item_count, lofi_probe_bound_t* _probe_bounds = nullptr) {
+		reset(_buckets, _bucket_count, _next_item, _item_count, _probe_bounds);
 	}
 
 	// master
-	void reset(lofi_bucket_t* _buckets, uint32_t _bucket_count, uint32_t* _next_item, uint32_t _item_count) {
+	// probe_bounds: bounded probing only, one per bucket, must be zeroed whenever buckets are zeroed
+	void reset(bucket_t* _buckets, uint32_t _bucket_count, uint32_t* _next_item, uint32_t _item_count, lofi_probe_bound_t* _probe_bounds = nullptr) {
 		assert(std::has_single_bit(_bucket_count));	
+		assert(_bucket_count <= max_buckets);
 		assert(_item_count <= _bucket_count);
+		assert(!has_probe_bounds || _probe_bounds);
 		buckets = _buckets;
 		capacity_m1 = _bucket_count - 1;
 		capacity_log2 = std::countr_zero(_bucket_count);
 		next_item = _next_item;
 		item_count = _item_count;
+		probe_bounds = _probe_bounds;
 	}
 
 	// mt function
@@ -231,58 +453,319 @@ struct lofi_hashtable_t {
 	// this list (lists) can be walked be lofi_list_walker_t utility
 	// last element is an element that has next pointing to itself
 	template<class hash_ops_t>
-	[[nodiscard]] lofi_insertion_t put(uint32_t item, const hash_ops_t& ops) {
+	[[nodiscard]] insertion_t put(uint32_t item, const hash_ops_t& ops) {
 		assert(item < item_count);
 
 		uint32_t hash = ops.hash(item);
 		uint32_t bucket_index = hash_to_index(hash);
 		for (uint32_t i = 0; i <= capacity_m1; i++) {
-			lofi_bucket_t& bucket = buckets[bucket_index];
+			bucket_t& bucket = buckets[bucket_index];
 
-			lofi_bucket_data_t old_data = std::atomic_ref(bucket.data).load(std::memory_order_relaxed);
-			lofi_bucket_data_t new_data{hash, item};
+			// acquire/release: item data read by ops.equals(head, ...) must be visible once head is published
+			bucket_data_t old_data = std::atomic_ref(bucket.data).load(std::memory_order_acquire);
+			bucket_data_t new_data{hash, item, generation};
 
-			if (!old_data.used() && std::atomic_ref(bucket.data).compare_exchange_strong(old_data, new_data, std::memory_order_relaxed)) {
+			if (!old_data.live(generation) && std::atomic_ref(bucket.data).compare_exchange_strong(old_data, new_data, std::memory_order_acq_rel, std::memory_order_acquire)) {
 				next_item[item] = item;
-				std::atomic_ref(bucket.count).fetch_add(1, std::memory_order_relaxed);
-				return lofi_insertion_t{bucket_index, 0, i, lofi_insertion_t::new_bucket_flag | lofi_insertion_t::inserted_flag};
+				increment_count(bucket);
+				update_probe_bound(hash, i);
+				return insertion_t{bucket_index, 0, i, insertion_t::new_bucket_flag | insertion_t::inserted_flag};
 			}
 
-			if (old_data.hash_equals(hash) && ops.equals(old_data.head(), item)) {
-				old_data = std::atomic_ref(bucket.data).exchange(new_data, std::memory_order_relaxed);
+			if (old_data.live(generation) && old_data.hash_equals(hash) && ops.equals(old_data.head(), item)) {
+				old_data = std::atomic_ref(bucket.data).exchange(new_data, std::memory_order_acq_rel);
 				next_item[item] = old_data.head();
-				std::atomic_ref(bucket.count).fetch_add(1, std::memory_order_relaxed);
-				return lofi_insertion_t{bucket_index, 0, i, lofi_insertion_t::inserted_flag};
+				increment_count(bucket);
+				update_probe_bound(hash, i);
+				return insertion_t{bucket_index, 0, i, insertion_t::inserted_flag};
 			}
 
 			bucket_index = (bucket_index + 1) & capacity_m1;
 		}
-		return lofi_failed_insertion;
+		return insertion_t{};
+	}
+
+	// partitioned build: buckets are split into 2^partition_log2 contiguous ranges,
+	// item belongs to the partition its home bucket falls into
+	uint32_t get_partition(uint32_t hash, uint32_t partition_log2) const {
+		assert(partition_log2 <= capacity_log2);
+		return hash_to_index(hash) >> (capacity_log2 - partition_log2);
+	}
+
+	// worker, partitioned build
+	// caller must exclusively own the partition of the item so plain stores are used, no atomics
+	// probing never leaves the partition, failed insertion means that item must be inserted with put after all owners finished
+	template<class hash_ops_t>
+	[[nodiscard]] insertion_t put_partitioned(uint32_t item, uint32_t partition_log2, const hash_ops_t& ops) {
+		assert(item < item_count);
+		assert(partition_log2 <= capacity_log2);
+
+		uint32_t hash = ops.hash(item);
+		uint32_t bucket_index = hash_to_index(hash);
+		uint32_t partition_shift = capacity_log2 - partition_log2;
+		uint32_t partition_stop = ((bucket_index >> partition_shift) + 1) << partition_shift;
+		for (uint32_t i = 0; bucket_index < partition_stop; i++, bucket_index++) {
+			bucket_t& bucket = buckets[bucket_index];
+
+			if (!bucket.data.live(generation)) {
+				bucket.data = bucket_data_t{hash, item, generation};
+				set_count(bucket, 1);
+				next_item[item] = item;
+				update_probe_bound(hash, i);
+				return insertion_t{bucket_index, 0, i, insertion_t::new_bucket_flag | insertion_t::inserted_flag};
+			}
+
+			if (bucket.data.hash_equals(hash) && ops.equals(bucket.data.head(), item)) {
+				next_item[item] = bucket.data.head();
+				bucket.data = bucket_data_t{hash, item, generation};
+				set_count(bucket, bucket.count + 1);
+				update_probe_bound(hash, i);
+				return insertion_t{bucket_index, 0, i, insertion_t::inserted_flag};
+			}
+		}
+		return insertion_t{};
 	}
 
 	// mt function, item_t can either be item itself or its integer handle
 	template<class item_t, class hash_ops_t>
-	[[nodiscard]] lofi_search_result_t get(const item_t& item, const hash_ops_t& ops) const {
+	[[nodiscard]] search_result_t get(const item_t& item, const hash_ops_t& ops) const {
 		uint32_t hash = ops.hash(item);
-		uint32_t bucket_index = hash_to_index(hash);
-		for (uint32_t i = 0; i <= capacity_m1; i++) {
-			lofi_bucket_t bucket = buckets[bucket_index]; // we can copy here
+		return probe(item, hash, hash_to_index(hash), ops);
+	}
+
+	// mt function, batched version of get, results must have space for count items
+	// software pipelined: all hashes are computed and home buckets are prefetched first, then probes are resolved
+	// if ops has void prefetch(uint32_t) it is called for the head of the home bucket (data used by equals) before resolving
+	template<class item_t, class hash_ops_t>
+	void get_many(const item_t* items, uint32_t count, search_result_t* results, const hash_ops_t& ops) const {
+		uint32_t hashes[lofi_get_many_batch];
 
-			if (bucket.data.used()) {
+		for (uint32_t start = 0; start < count; start += lofi_get_many_batch) {
+			const uint32_t batch_size = std::min(count - start, lofi_get_many_batch);
+			for (uint32_t k = 0; k < batch_size; k++) {
+				hashes[k] = ops.hash(items[start + k]);
+			}
+			get_many(items + start, hashes, batch_size, results + start, ops);
+		}
+	}
+
+	// mt function, same as get_many but with hashes precomputed by the caller (e.g. batch hashed with SIMD)
+	// hashes[i] must equal ops.hash(items[i])
+	template<class item_t, class hash_ops_t>
+	void get_many(const item_t* items, const uint32_t* item_hashes, uint32_t count, search_result_t* results, const hash_ops_t& ops) const {
+		uint32_t bucket_indices[lofi_get_many_batch];
+
+		for (uint32_t start = 0; start < count; start += lofi_get_many_batch) {
+			const uint32_t batch_size = std::min(count - start, lofi_get_many_batch);
+			const item_t* batch_items = items + start;
+			const uint32_t* hashes = item_hashes + start;
+
+			for (uint32_t k = 0; k < batch_size; k++) {
+				bucket_indices[k] = hash_to_index(hashes[k]);
+				lofi_prefetch(&buckets[bucket_indices[k]]);
+				if constexpr (has_probe_bounds) {
+					lofi_prefetch(&probe_bounds[bucket_indices[k]]);
+				}
+			}
+
+			if constexpr (requires { ops.prefetch(uint32_t{}); }) {
+				for (uint32_t k = 0; k < batch_size; k++) {
+					bucket_data_t data = buckets[bucket_indices[k]].data;
+					if (data.live(generation) && data.hash_equals(hashes[k])) {
+						ops.prefetch(data.head());
+					}
+				}
+			}
+
+			for (uint32_t k = 0; k < batch_size; k++) {
+				results[start + k] = probe(batch_items[k], hashes[k], bucket_indices[k], ops);
+			}
+		}
+	}
+
+	// mt function, linear probing starting from the bucket_index (home bucket of the hash)
+	// in case of a miss scans is the count of occupied buckets examined
+	template<class item_t, class hash_ops_t>
+	[[nodiscard]] search_result_t probe(const item_t& item, uint32_t hash, uint32_t bucket_index, const hash_ops_t& ops) const {
+		const uint32_t probe_length = get_probe_length(bucket_index);
+		for (uint32_t i = 0; i < probe_length; i++) {
+			bucket_t bucket = buckets[bucket_index]; // we can copy here
+
+			if (bucket.data.live(generation)) {
 				uint32_t head = bucket.data.head();
-				if (bucket.data.hash_equals(hash) && ops.equals(head, item)) {
-					return lofi_search_result_t{bucket, bucket_index, i};
+				if (!is_tombstone(bucket) && bucket.data.hash_equals(hash) && ops.equals(head, item)) {
+					return search_result_t{bucket, bucket_index, i};
 				}
 			} else {
-				return lofi_search_result_t{};
+				return search_result_t{bucket_t{}, 0, i};
+			}
+
+			bucket_index = (bucket_index + 1) & capacity_m1;
+		}
+		return search_result_t{bucket_t{}, 0, probe_length};
+	}
+
+	// master, incremental maintenance (don't mix with put until the table is reset)
+	// links item into the list of its key, list is kept doubly-linked: prev_item[head] == head, next_item[tail] == tail
+	// if key is not present item is put into the first tombstone met during probing or into an empty bucket
+	// new_bucket flag is set only in the latter case
+	template<class hash_ops_t>
+	[[nodiscard]] insertion_t link(uint32_t item, uint32_t* prev_item, const hash_ops_t& ops) {
+		assert(item < item_count);
+
+		constexpr uint32_t none = ~(uint32_t)0;
+
+		uint32_t hash = ops.hash(item);
+		uint32_t bucket_index = hash_to_index(hash);
+		uint32_t tombstone_index = none;
+		uint32_t tombstone_scans = 0;
+		for (uint32_t i = 0; i <= capacity_m1; i++) {
+			bucket_t& bucket = buckets[bucket_index];
+
+			if (!bucket.data.live(generation)) {
+				if (tombstone_index != none) {
+					break;
+				}
+				bucket.data = bucket_data_t{hash, item, generation};
+				set_count(bucket, 1);
+				next_item[item] = item;
+				prev_item[item] = item;
+				update_probe_bound(hash, i);
+				return insertion_t{bucket_index, 0, i, insertion_t::inserted_flag | insertion_t::new_bucket_flag};
+			}
+
+			if (is_tombstone(bucket)) {
+				if (tombstone_index == none) {
+					tombstone_index = bucket_index;
+					tombstone_scans = i;
+				}
+			} else if (bucket.data.hash_equals(hash) && ops.equals(bucket.data.head(), item)) {
+				uint32_t head = bucket.data.head();
+				next_item[item] = head;
+				prev_item[item] = item;
+				prev_item[head] = item;
+				bucket.data = bucket_data_t{hash, item, generation};
+				set_count(bucket, bucket.count + 1);
+				return insertion_t{bucket_index, 0, i, insertion_t::inserted_flag};
 			}
 
 			bucket_index = (bucket_index + 1) & capacity_m1;
 		}
-		return lofi_search_result_t{};
+
+		if (tombstone_index != none) {
+			buckets[tombstone_index].data = bucket_data_t{hash, item, generation};
+			set_count(buckets[tombstone_index], 1);
+			next_item[item] = item;
+			prev_item[item] = item;
+			update_probe_bound(hash, tombstone_scans);
+			return insertion_t{tombstone_index, 0, tombstone_scans, insertion_t::inserted_flag};
+		}
+		return insertion_t{};
+	}
+
+	// master, incremental maintenance
+	// removes item from the list of the bucket it was linked into, see link
+	// bucket keeps its data but becomes a tombstone once its last item is removed (so probe sequences stay intact)
+	// returns true if bucket became a tombstone
+	bool unlink(uint32_t bucket_index, uint32_t item, uint32_t* prev_item) {
+		assert(item < item_count);
+
+		bucket_t& bucket = buckets[bucket_index];
+		assert(bucket.data.live(generation) && !is_tombstone(bucket));
+
+		uint32_t prev = prev_item[item];
+		uint32_t next = next_item[item];
+		if (prev == item) {
+			assert(bucket.data.head() == item);
+			if (next == item) {
+				set_count(bucket, 0);
+				return true;
+			}
+			prev_item[next] = next;
+			bucket.data.set_head(next);
+		} else if (next == item) {
+			next_item[prev] = prev;
+		} else {
+			next_item[prev] = next;
+			prev_item[next] = prev;
+		}
+		set_count(bucket, bucket.count - 1);
+		return false;
+	}
+
+	// mt function, bounded probing only: max probe distance from home bucket of the hash
+	void update_probe_bound(uint32_t hash, uint32_t scans) {
+		if constexpr (has_probe_bounds) {
+			const lofi_probe_bound_t new_bound = (lofi_probe_bound_t)((generation << 8) | std::min(scans, lofi_max_probe_bound));
+
+			lofi_probe_bound_t& bound = probe_bounds[hash_to_index(hash)];
+			lofi_probe_bound_t old_bound = std::atomic_ref(bound).load(std::memory_order_relaxed);
+			while ((old_bound >> 8) != generation || (old_bound & 0xFF) < (new_bound & 0xFF)) {
+				if (std::atomic_ref(bound).compare_exchange_weak(old_bound, new_bound, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+		}
+	}
+
+	// max count of buckets lookup starting from home bucket has to scan
+	uint32_t get_probe_length(uint32_t home_index) const {
+		if constexpr (has_probe_bounds) {
+			const lofi_probe_bound_t bound = probe_bounds[home_index];
+			if ((bound >> 8) != generation) {
+				return 0; // nothing was inserted from this home bucket, miss without touching buckets
+			}
+			const uint32_t scans = bound & 0xFF;
+			return scans == lofi_max_probe_bound ? capacity_m1 + 1 : scans + 1;
+		} else {
+			return capacity_m1 + 1;
+		}
+	}
+
+	// live bucket without items, left by unlink
+	bool is_tombstone(const bucket_t& bucket) const {
+		return (uint32_t)bucket.count == 0;
+	}
+
+	// master or owner of the bucket
+	void set_count(bucket_t& bucket, uint32_t count) {
+		if constexpr (has_generations) {
+			bucket.count = typename bucket_t::count_t{count, generation};
+		} else {
+			bucket.count = count;
+		}
+	}
+
+	// mt function
+	void increment_count(bucket_t& bucket) {
+		if constexpr (has_generations) {
+			using count_t = typename bucket_t::count_t;
+
+			count_t old_count = std::atomic_ref(bucket.count).load(std::memory_order_relaxed);
+			count_t new_count{};
+			do {
+				new_count.value = old_count.generation == generation ? old_count.value + 1 : 1;
+				new_count.generation = generation;
+			} while (!std::atomic_ref(bucket.count).compare_exchange_weak(old_count, new_count, std::memory_order_relaxed));
+		} else {
+			std::atomic_ref(bucket.count).fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	// master, generation layouts only
+	// invalidates all buckets in O(1): only buckets filled during the current generation are considered used
+	// returns false on wrap-around, then all buckets must be zeroed before the table is used again
+	[[nodiscard]] bool advance_generation() {
+		static_assert(has_generations, "layout has no generations");
+		if (generation < max_generation) {
+			generation++;
+			return true;
+		}
+		generation = 1;
+		return false;
 	}
 
-	lofi_bucket_t get_bucket(uint32_t index) const {
+	bucket_t get_bucket(uint32_t index) const {
 		return buckets[index];
 	}
 
@@ -303,13 +786,20 @@ struct lofi_hashtable_t {
 		return lofi_flat_list_walker_t{next_item, item_count, head};
 	}
 
-	lofi_bucket_t* buckets{};
+	bucket_t* buckets{};
 	uint32_t capacity_m1{}; // TODO : rename to bucket_capacity_m1
 	uint32_t capacity_log2{}; // TODO : rename to capacity_log2
 	uint32_t* next_item{};
 	uint32_t item_count{};
+	uint32_t generation{1}; // zeroed buckets are never live
+	lofi_probe_bound_t* probe_bounds{};
 };
 
+using lofi_hashtable_t = lofi_basic_hashtable_t<lofi_compact_layout_t>;
+using lofi_wide_hashtable_t = lofi_basic_hashtable_t<lofi_wide_layout_t>;
+using lofi_generation_hashtable_t = lofi_basic_hashtable_t<lofi_generation_layout_t>;
+using lofi_bounded_generation_hashtable_t = lofi_basic_hashtable_t<lofi_generation_layout_t, lofi_bounded_probing_t>;
+
 template<class type_t>
 struct lofi_view_t {
 	type_t& operator[] (int index) const {
@@ -350,6 +840,128 @@ auto lofi_create_view(type_t* data, int start, int size) {
 	return lofi_view_t{data + start, size};
 }
 
+// bloom-style occupancy filter (2 bits per key) kept next to the hashtable so that misses can be rejected
+// without touching bucket memory, meant to be small enough to stay in cache
+// bits are never removed (removed keys only raise false positive rate), owner clears words when table is rebuilt
+struct lofi_occupancy_filter_t {
+	static constexpr uint32_t word_bits = 64;
+	static constexpr uint32_t word_bits_log2 = 6;
+
+	// 64 bit shift, bit_count_log2 == 32 is allowed
+	static uint32_t word_count(uint32_t bit_count_log2) {
+		return (uint32_t)(((uint64_t)1 << bit_count_log2) / word_bits);
+	}
+
+	// master
+	void reset(uint64_t* _words, uint32_t _bit_count_log2) {
+		assert(_bit_count_log2 >= word_bits_log2 && _bit_count_log2 <= 32);
+		words = _words;
+		bit_count_log2 = _bit_count_log2;
+	}
+
+	// master
+	void clear() {
+		std::memset(words, 0x00, word_count(bit_count_log2) * sizeof(uint64_t));
+	}
+
+	// mt function
+	void insert(uint32_t hash) {
+		auto [bit0, bit1] = get_bits(hash);
+		set_bit(bit0);
+		set_bit(bit1);
+	}
+
+	// mt function, false means that key with such hash was never inserted
+	bool may_contain(uint32_t hash) const {
+		auto [bit0, bit1] = get_bits(hash);
+		return test_bit(bit0) && test_bit(bit1);
+	}
+
+	// two independent bit positions derived from one hash (multiplicative hashing, top bits)
+	std::tuple<uint32_t, uint32_t> get_bits(uint32_t hash) const {
+		const uint32_t shift = 32 - bit_count_log2;
+		uint32_t bit0 = (uint32_t)(hash * 0x9E3779B1u) >> shift;
+		uint32_t bit1 = (uint32_t)(hash * 0x85EBCA77u) >> shift;
+		return {bit0, bit1};
+	}
+
+	void set_bit(uint32_t bit) {
+		uint64_t& word = words[bit >> word_bits_log2];
+		uint64_t mask = (uint64_t)1 << (bit & (word_bits - 1));
+		if (!(std::atomic_ref(word).load(std::memory_order_relaxed) & mask)) { // avoid needless rmw on hot words
+			std::atomic_ref(word).fetch_or(mask, std::memory_order_relaxed);
+		}
+	}
+
+	bool test_bit(uint32_t bit) const {
+		return words[bit >> word_bits_log2] & ((uint64_t)1 << (bit & (word_bits - 1)));
+	}
+
+	uint64_t* words{};
+	uint32_t bit_count_log2{};
+};
+
+// partitioned build helper
+// every job bins items of its range by partition (counting sort within the range, so no synchronization needed),
+// then owner of a partition collects its items from all jobs via view(job_id, partition)
+struct lofi_partition_bins_t {
+	static constexpr uint32_t max_partition_log2 = 8;
+	static constexpr uint32_t max_partitions = 1 << max_partition_log2;
+
+	// master
+	// binned_items must have space for all items, offsets for job_count * (2^partition_log2 + 1) values
+	void reset(uint32_t* _binned_items, uint32_t* _offsets, uint32_t _job_count, uint32_t _partition_log2) {
+		assert(_partition_log2 <= max_partition_log2);
+		binned_items = _binned_items;
+		offsets = _offsets;
+		job_count = _job_count;
+		partition_log2 = _partition_log2;
+	}
+
+	// worker, bins items [start, stop), get_partition(item) -> partition
+	template<class get_partition_t>
+	void bin(uint32_t job_id, uint32_t start, uint32_t stop, const get_partition_t& get_partition) {
+		assert(job_id < job_count);
+
+		const uint32_t partitions = partition_count();
+
+		uint32_t* job_offsets = offsets + job_id * (partitions + 1);
+		std::memset(job_offsets, 0x00, (partitions + 1) * sizeof(uint32_t));
+		for (uint32_t item = start; item < stop; item++) {
+			job_offsets[get_partition(item) + 1]++;
+		}
+
+		uint32_t fill[max_partitions];
+		job_offsets[0] = start;
+		for (uint32_t p = 0; p < partitions; p++) {
+			job_offsets[p + 1] += job_offsets[p];
+			fill[p] = job_offsets[p];
+		}
+		for (uint32_t item = start; item < stop; item++) {
+			binned_items[fill[get_partition(item)]++] = item;
+		}
+	}
+
+	// worker, valid after all jobs finished binning
+	lofi_view_t<uint32_t> view(uint32_t job_id, uint32_t partition) const {
+		const uint32_t* job_offsets = offsets + job_id * (partition_count() + 1);
+		return lofi_view_t<uint32_t>{binned_items + job_offsets[partition], (int)(job_offsets[partition + 1] - job_offsets[partition])};
+	}
+
+	uint32_t partition_count() const {
+		return 1 << partition_log2;
+	}
+
+	static uint32_t offsets_size(uint32_t job_count, uint32_t partition_log2) {
+		return job_count * ((1 << partition_log2) + 1);
+	}
+
+	uint32_t* binned_items{};
+	uint32_t* offsets{};
+	uint32_t job_count{};
+	uint32_t partition_log2{};
+};
+
 template<class type_t>
 struct lofi_stack_alloc_t {
 	lofi_stack_alloc_t() = default;
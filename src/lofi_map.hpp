@@ -0,0 +1,183 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "lofi.hpp"
+
+// default hash policy: std::hash folded to 32 bits
+template<class key_t>
+struct lofi_default_hasher_t {
+	uint32_t operator() (const key_t& key) const {
+		uint64_t h = std::hash<key_t>{}(key);
+		return (uint32_t)(h ^ (h >> 32));
+	}
+};
+
+// owning concurrent multimap on top of lofi_basic_hashtable_t
+// - same semantics as the table: lock-free insert, values of the same key are grouped into one list
+// - inserts and lookups must be separated (all inserts finished before the first lookup), as with the raw table
+// - reset plans capacity, buffers only grow and are reused across rebuilds
+// hasher_t : uint32_t operator() (const key_t&), equal_t : bool operator() (const key_t&, const key_t&)
+// key_t & value_t must be default constructible and copy assignable
+template<class __key_t, class __value_t,
+	class __hasher_t = lofi_default_hasher_t<__key_t>,
+	class __equal_t = std::equal_to<__key_t>,
+	class __hashtable_t = lofi_generation_hashtable_t>
+class lofi_map_t {
+public:
+	using key_t = __key_t;
+	using value_t = __value_t;
+	using hasher_t = __hasher_t;
+	using equal_t = __equal_t;
+	using hashtable_t = __hashtable_t;
+	using bucket_t = typename hashtable_t::bucket_t;
+
+	static constexpr uint32_t min_buckets = 64;
+
+	struct hash_ops_t {
+		uint32_t hash(uint32_t slot) const {
+			return map->hashes[slot];
+		}
+
+		uint32_t hash(const key_t& key) const {
+			return map->hasher(key);
+		}
+
+		bool equals(uint32_t slot1, uint32_t slot2) const {
+			return map->equal(map->keys[slot1], map->keys[slot2]);
+		}
+
+		bool equals(uint32_t slot, const key_t& key) const {
+			return map->equal(map->keys[slot], key);
+		}
+
+		void prefetch(uint32_t slot) const {
+			lofi_prefetch(&map->keys[slot]);
+		}
+
+		const lofi_map_t* map{};
+	};
+
+	lofi_map_t(const hasher_t& _hasher = {}, const equal_t& _equal = {})
+		: hasher{_hasher}
+		, equal{_equal}
+	{}
+
+	// master, table is emptied and prepared to take up to max_items values
+	void reset(uint32_t max_items) {
+		const uint32_t bucket_count = std::max<uint32_t>(nextpow2(max_items) * 2, min_buckets); // load factor <= 0.5
+		assert(bucket_count <= hashtable_t::max_buckets);
+
+		bool cleared = false;
+		if (buckets.size() < bucket_count) {
+			buckets.resize(bucket_count);
+			if constexpr (hashtable_t::has_probe_bounds) {
+				probe_bounds.resize(bucket_count);
+			}
+		}
+		if (keys.size() < max_items) {
+			keys.resize(max_items);
+			values.resize(max_items);
+			hashes.resize(max_items);
+			next.resize(max_items);
+		}
+
+		if constexpr (hashtable_t::has_generations) {
+			cleared = table.advance_generation(); // O(1) unless generation wraps around
+		}
+		if (!cleared) {
+			std::fill(buckets.begin(), buckets.end(), bucket_t{});
+			if constexpr (hashtable_t::has_probe_bounds) {
+				std::fill(probe_bounds.begin(), probe_bounds.end(), lofi_probe_bound_t{});
+			}
+		}
+
+		table.reset(buckets.data(), bucket_count, next.data(), max_items, probe_bounds.data());
+		capacity = max_items;
+		top = 0;
+	}
+
+	// mt function, returns false if map is full
+	bool insert(const key_t& key, const value_t& value) {
+		const uint32_t slot = std::atomic_ref(top).fetch_add(1, std::memory_order_relaxed);
+		if (slot >= capacity) {
+			return false;
+		}
+
+		keys[slot] = key;
+		values[slot] = value;
+		hashes[slot] = hasher(key);
+
+		auto insertion = table.put(slot, hash_ops_t{this});
+		assert(insertion.inserted());
+		return insertion.inserted();
+	}
+
+	// mt function, calls func(const value_t&) for every value of the key
+	template<class func_t>
+	void for_each(const key_t& key, func_t&& func) const {
+		auto result = table.get(key, hash_ops_t{this});
+		if (!result.valid()) {
+			return;
+		}
+		for (auto it = table.iter(result.head()); it.valid(); it.next()) {
+			func(values[it.get()]);
+		}
+	}
+
+	// mt function, count of values stored under the key
+	uint32_t count(const key_t& key) const {
+		auto result = table.get(key, hash_ops_t{this});
+		return result.valid() ? result.count() : 0;
+	}
+
+	bool contains(const key_t& key) const {
+		return count(key) != 0;
+	}
+
+	// calls func(const key_t&, lofi_flat_list_walker_t) for every distinct key, walker yields slots, see value_at
+	// scans bucket array so cost is proportional to capacity
+	template<class func_t>
+	void for_each_group(func_t&& func) const {
+		for (uint32_t i = 0; i < table.get_capacity(); i++) {
+			bucket_t bucket = table.get_bucket(i);
+			if (bucket.data.live(table.generation) && !table.is_tombstone(bucket)) {
+				func(keys[bucket.head()], table.iter(bucket.head()));
+			}
+		}
+	}
+
+	const value_t& value_at(uint32_t slot) const {
+		assert(slot < size());
+		return values[slot];
+	}
+
+	uint32_t size() const {
+		return std::min(top, capacity);
+	}
+
+	uint32_t get_capacity() const {
+		return capacity;
+	}
+
+	const hashtable_t& get_table() const {
+		return table;
+	}
+
+private:
+	hasher_t hasher{};
+	equal_t equal{};
+
+	std::vector<key_t> keys{};
+	std::vector<value_t> values{};
+	std::vector<uint32_t> hashes{};
+	std::vector<uint32_t> next{};
+	std::vector<bucket_t> buckets{};
+	std::vector<lofi_probe_bound_t> probe_bounds{};
+
+	hashtable_t table{};
+	uint32_t capacity{};
+	uint32_t top{}; // atomic, managed via std::atomic_ref
+};
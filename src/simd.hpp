@@ -1,9 +1,415 @@
 #pragma once
 
+#include <bit>
+#include <cmath>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
 #include <immintrin.h>
 
-#ifdef YIN_YANG_USE_SIMD
-inline constexpr const char* yin_yang_use_simd = "yes";
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// kernels for every level are compiled into the same binary, the best one supported by the cpu is picked at runtime
+// gcc & clang need target attributes to use intrinsics above the baseline, msvc allows them anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define YIN_YANG_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define YIN_YANG_TARGET_AVX2 __attribute__((target("avx2")))
+#define YIN_YANG_TARGET_AVX512 __attribute__((target("avx512f,avx2")))
+#else
+#define YIN_YANG_TARGET_SSE42
+#define YIN_YANG_TARGET_AVX2
+#define YIN_YANG_TARGET_AVX512
+#endif
+
+enum class simd_level_t : int {
+	Scalar,
+	Sse42, // only the cell hash (crc32), vector kernels use the scalar flavour
+	Avx2,
+	Avx512,
+	Count
+};
+
+inline constexpr const char* simd_level_names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+
+inline const char* simd_level_name(simd_level_t level) {
+	return simd_level_names[(int)level];
+}
+
+// returns Count if name is unknown
+inline simd_level_t simd_level_from_name(const char* name) {
+	for (int i = 0; i < (int)simd_level_t::Count; i++) {
+		if (std::strcmp(simd_level_names[i], name) == 0) {
+			return (simd_level_t)i;
+		}
+	}
+	return simd_level_t::Count;
+}
+
+inline simd_level_t simd_detect_level() {
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return simd_level_t::Avx512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return simd_level_t::Avx2;
+	}
+	if (__builtin_cpu_supports("sse4.2")) {
+		return simd_level_t::Sse42;
+	}
+	return simd_level_t::Scalar;
+#elif defined(_MSC_VER)
+	int info[4]{};
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse42 = (info[2] & (1 << 20)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!sse42) {
+		return simd_level_t::Scalar;
+	}
+
+	// os must save ymm (and zmm) state
+	const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	if (!avx || (xcr0 & 0x6) != 0x6 || max_leaf < 7) {
+		return simd_level_t::Sse42;
+	}
+
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	const bool avx512f = (info[1] & (1 << 16)) != 0;
+	if (avx512f && (xcr0 & 0xE6) == 0xE6) {
+		return simd_level_t::Avx512;
+	}
+	return avx2 ? simd_level_t::Avx2 : simd_level_t::Sse42;
 #else
-inline constexpr const char* yin_yang_use_simd = "no";
-#endif
\ No newline at end of file
+	return simd_level_t::Scalar;
+#endif
+}
+
+// level supported by the cpu, detected once
+inline simd_level_t simd_cpu_level() {
+	static const simd_level_t level = simd_detect_level();
+	return level;
+}
+
+namespace simd_detail {
+	// YIN_YANG_SIMD=scalar|sse4.2|avx2|avx512 caps the level at startup
+	inline simd_level_t initial_level() {
+		simd_level_t level = simd_cpu_level();
+		if (const char* env = std::getenv("YIN_YANG_SIMD")) {
+			simd_level_t requested = simd_level_from_name(env);
+			if (requested != simd_level_t::Count && requested < level) {
+				level = requested;
+			}
+		}
+		return level;
+	}
+
+	inline std::atomic<int> level{(int)initial_level()};
+}
+
+// level used by dispatched kernels
+inline simd_level_t simd_level() {
+	return (simd_level_t)simd_detail::level.load(std::memory_order_relaxed);
+}
+
+// forces a level (e.g. for benchmarking), returns false if the cpu does not support it
+// must not be changed while data hashed with level dependent hashers (sparse_cell_hasher_t) is in use
+inline bool simd_force_level(simd_level_t level) {
+	if (level >= simd_level_t::Count || level > simd_cpu_level()) {
+		return false;
+	}
+	simd_detail::level.store((int)level, std::memory_order_relaxed);
+	return true;
+}
+
+
+// vector kernel library
+// simd_scalar_t, simd_avx2_t & simd_avx512_t share one interface so a kernel is written once as a template over the flavour:
+//   template<class v_t> YIN_YANG_FORCE_INLINE uint32_t kernel(...) { ... }
+//   YIN_YANG_TARGET_AVX2 uint32_t kernel_avx2(...) { return kernel<simd_avx2_t>(...); }
+// kernel must be force inlined into the target entry point, otherwise flavour ops can't be inlined into it
+// - f32 / i32 : float & int32 lanes, mask_t : lane mask (first n lanes via tail_mask(n))
+// - masked loads zero inactive lanes, masked stores don't touch memory of inactive lanes
+// - i32 arithmetic wraps (same as uint32_t)
+#if defined(__GNUC__) || defined(__clang__)
+#define YIN_YANG_FORCE_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define YIN_YANG_FORCE_INLINE __forceinline
+#else
+#define YIN_YANG_FORCE_INLINE inline
+#endif
+
+// constexpr table of lane masks for maskload/maskstore, table[n] has first n lanes set
+template<int lanes>
+struct simd_mask_table_t {
+	constexpr simd_mask_table_t() {
+		for (int n = 0; n <= lanes; n++) {
+			for (int i = 0; i < lanes; i++) {
+				masks[n][i] = i < n ? -1 : 0;
+			}
+		}
+	}
+
+	const int* operator[] (int n) const {
+		return masks[n];
+	}
+
+	alignas(64) int masks[lanes + 1][lanes] = {};
+};
+
+inline constexpr simd_mask_table_t<8> simd_mask_table8{};
+
+struct simd_scalar_t {
+	using f32 = float;
+	using i32 = int32_t;
+	using mask_t = bool;
+
+	static constexpr int lanes = 1;
+
+	static f32 set1(float v) { return v; }
+	static i32 set1(int32_t v) { return v; }
+	static f32 zero_f32() { return 0.0f; }
+	static i32 zero_i32() { return 0; }
+	static i32 lane_index(int32_t /*stride*/) { return 0; }
+
+	static f32 load(const float* p) { return *p; }
+	static i32 load(const int32_t* p) { return *p; }
+	static void store(float* p, f32 v) { *p = v; }
+	static void store(int32_t* p, i32 v) { *p = v; }
+
+	static mask_t tail_mask(int count) { return count > 0; }
+	static f32 load(const float* p, mask_t m) { return m ? *p : 0.0f; }
+	static i32 load(const int32_t* p, mask_t m) { return m ? *p : 0; }
+	static void store(float* p, f32 v, mask_t m) { if (m) { *p = v; } }
+	static void store(int32_t* p, i32 v, mask_t m) { if (m) { *p = v; } }
+
+	static f32 gather(const float* base, i32 index) { return base[index]; }
+	static i32 gather(const int32_t* base, i32 index) { return base[index]; }
+	static void scatter(int32_t* base, i32 index, i32 v) { base[index] = v; }
+
+	static f32 add(f32 a, f32 b) { return a + b; }
+	static f32 sub(f32 a, f32 b) { return a - b; }
+	static f32 mul(f32 a, f32 b) { return a * b; }
+	static f32 div(f32 a, f32 b) { return a / b; }
+	static f32 min(f32 a, f32 b) { return a < b ? a : b; } // same operand order as minps / maxps
+	static f32 max(f32 a, f32 b) { return a > b ? a : b; }
+	static f32 sqrt(f32 a) { return std::sqrt(a); }
+	static f32 floor(f32 a) { return std::floor(a); }
+	static f32 rsqrt(f32 a) { return 1.0f / std::sqrt(a); }
+	static i32 cvtt(f32 a) { return (int32_t)a; }
+
+	static i32 add(i32 a, i32 b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+	static i32 mullo(i32 a, i32 b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+	static i32 bit_xor(i32 a, i32 b) { return a ^ b; }
+	template<int r> static i32 shl(i32 a) { return (int32_t)((uint32_t)a << r); }
+	template<int r> static i32 shr(i32 a) { return (int32_t)((uint32_t)a >> r); }
+	template<int r> static i32 rotl(i32 a) { return (int32_t)(((uint32_t)a << r) | ((uint32_t)a >> (32 - r))); }
+
+	static mask_t cmp_lt(f32 a, f32 b) { return a < b; }
+	static mask_t cmp_ge(f32 a, f32 b) { return a >= b; }
+	static mask_t mask_and(mask_t a, mask_t b) { return a && b; }
+	static f32 mask_zero(mask_t m, f32 a) { return m ? a : 0.0f; }
+	static int mask_count(mask_t m) { return m; }
+
+	static float hsum(f32 a) { return a; }
+	static float hmin(f32 a) { return a; }
+	static float hmax(f32 a) { return a; }
+};
+
+struct simd_avx2_t {
+	using f32 = __m256;
+	using i32 = __m256i;
+	using mask_t = __m256i;
+
+	static constexpr int lanes = 8;
+
+	YIN_YANG_TARGET_AVX2 static f32 set1(float v) { return _mm256_set1_ps(v); }
+	YIN_YANG_TARGET_AVX2 static i32 set1(int32_t v) { return _mm256_set1_epi32(v); }
+	YIN_YANG_TARGET_AVX2 static f32 zero_f32() { return _mm256_setzero_ps(); }
+	YIN_YANG_TARGET_AVX2 static i32 zero_i32() { return _mm256_setzero_si256(); }
+	YIN_YANG_TARGET_AVX2 static i32 lane_index(int32_t stride) { return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride)); }
+
+	YIN_YANG_TARGET_AVX2 static f32 load(const float* p) { return _mm256_loadu_ps(p); }
+	YIN_YANG_TARGET_AVX2 static i32 load(const int32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	YIN_YANG_TARGET_AVX2 static void store(float* p, f32 v) { _mm256_storeu_ps(p, v); }
+	YIN_YANG_TARGET_AVX2 static void store(int32_t* p, i32 v) { _mm256_storeu_si256((__m256i*)p, v); }
+
+	YIN_YANG_TARGET_AVX2 static mask_t tail_mask(int count) { return _mm256_load_si256((const __m256i*)simd_mask_table8[count < 0 ? 0 : count > 8 ? 8 : count]); }
+	YIN_YANG_TARGET_AVX2 static f32 load(const float* p, mask_t m) { return _mm256_maskload_ps(p, m); }
+	YIN_YANG_TARGET_AVX2 static i32 load(const int32_t* p, mask_t m) { return _mm256_maskload_epi32(p, m); }
+	YIN_YANG_TARGET_AVX2 static void store(float* p, f32 v, mask_t m) { _mm256_maskstore_ps(p, m, v); }
+	YIN_YANG_TARGET_AVX2 static void store(int32_t* p, i32 v, mask_t m) { _mm256_maskstore_epi32(p, m, v); }
+
+	YIN_YANG_TARGET_AVX2 static f32 gather(const float* base, i32 index) { return _mm256_i32gather_ps(base, index, 4); }
+	YIN_YANG_TARGET_AVX2 static i32 gather(const int32_t* base, i32 index) { return _mm256_i32gather_epi32(base, index, 4); }
+
+	// no scatter in AVX2
+	YIN_YANG_TARGET_AVX2 static void scatter(int32_t* base, i32 index, i32 v) {
+		alignas(32) int32_t indices[8];
+		alignas(32) int32_t values[8];
+		_mm256_store_si256((__m256i*)indices, index);
+		_mm256_store_si256((__m256i*)values, v);
+		for (int k = 0; k < 8; k++) {
+			base[indices[k]] = values[k];
+		}
+	}
+
+	YIN_YANG_TARGET_AVX2 static f32 add(f32 a, f32 b) { return _mm256_add_ps(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 sub(f32 a, f32 b) { return _mm256_sub_ps(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 mul(f32 a, f32 b) { return _mm256_mul_ps(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 div(f32 a, f32 b) { return _mm256_div_ps(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 min(f32 a, f32 b) { return _mm256_min_ps(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 max(f32 a, f32 b) { return _mm256_max_ps(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 sqrt(f32 a) { return _mm256_sqrt_ps(a); }
+	YIN_YANG_TARGET_AVX2 static f32 floor(f32 a) { return _mm256_floor_ps(a); }
+	YIN_YANG_TARGET_AVX2 static i32 cvtt(f32 a) { return _mm256_cvttps_epi32(a); }
+
+	// ~12 bit estimate + one Newton step: y = y * (1.5 - 0.5 * a * y * y)
+	YIN_YANG_TARGET_AVX2 static f32 rsqrt(f32 a) {
+		const f32 y = _mm256_rsqrt_ps(a);
+		const f32 hay2 = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), a), _mm256_mul_ps(y, y));
+		return _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), hay2));
+	}
+
+	YIN_YANG_TARGET_AVX2 static i32 add(i32 a, i32 b) { return _mm256_add_epi32(a, b); }
+	YIN_YANG_TARGET_AVX2 static i32 mullo(i32 a, i32 b) { return _mm256_mullo_epi32(a, b); }
+	YIN_YANG_TARGET_AVX2 static i32 bit_xor(i32 a, i32 b) { return _mm256_xor_si256(a, b); }
+	template<int r> YIN_YANG_TARGET_AVX2 static i32 shl(i32 a) { return _mm256_slli_epi32(a, r); }
+	template<int r> YIN_YANG_TARGET_AVX2 static i32 shr(i32 a) { return _mm256_srli_epi32(a, r); }
+	template<int r> YIN_YANG_TARGET_AVX2 static i32 rotl(i32 a) { return _mm256_or_si256(_mm256_slli_epi32(a, r), _mm256_srli_epi32(a, 32 - r)); }
+
+	YIN_YANG_TARGET_AVX2 static mask_t cmp_lt(f32 a, f32 b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+	YIN_YANG_TARGET_AVX2 static mask_t cmp_ge(f32 a, f32 b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GE_OQ)); }
+	YIN_YANG_TARGET_AVX2 static mask_t mask_and(mask_t a, mask_t b) { return _mm256_and_si256(a, b); }
+	YIN_YANG_TARGET_AVX2 static f32 mask_zero(mask_t m, f32 a) { return _mm256_and_ps(_mm256_castsi256_ps(m), a); }
+	YIN_YANG_TARGET_AVX2 static int mask_count(mask_t m) { return std::popcount((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m))); }
+
+	YIN_YANG_TARGET_AVX2 static float hsum(f32 a) {
+		__m128 v = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_add_ss(v, _mm_movehdup_ps(v));
+		return _mm_cvtss_f32(v);
+	}
+
+	YIN_YANG_TARGET_AVX2 static float hmin(f32 a) {
+		__m128 v = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_min_ss(v, _mm_movehdup_ps(v));
+		return _mm_cvtss_f32(v);
+	}
+
+	YIN_YANG_TARGET_AVX2 static float hmax(f32 a) {
+		__m128 v = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_max_ss(v, _mm_movehdup_ps(v));
+		return _mm_cvtss_f32(v);
+	}
+};
+
+struct simd_avx512_t {
+	using f32 = __m512;
+	using i32 = __m512i;
+	using mask_t = __mmask16;
+
+	static constexpr int lanes = 16;
+
+	YIN_YANG_TARGET_AVX512 static f32 set1(float v) { return _mm512_set1_ps(v); }
+	YIN_YANG_TARGET_AVX512 static i32 set1(int32_t v) { return _mm512_set1_epi32(v); }
+	YIN_YANG_TARGET_AVX512 static f32 zero_f32() { return _mm512_setzero_ps(); }
+	YIN_YANG_TARGET_AVX512 static i32 zero_i32() { return _mm512_setzero_si512(); }
+	YIN_YANG_TARGET_AVX512 static i32 lane_index(int32_t stride) {
+		return _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(stride));
+	}
+
+	YIN_YANG_TARGET_AVX512 static f32 load(const float* p) { return _mm512_loadu_ps(p); }
+	YIN_YANG_TARGET_AVX512 static i32 load(const int32_t* p) { return _mm512_loadu_si512(p); }
+	YIN_YANG_TARGET_AVX512 static void store(float* p, f32 v) { _mm512_storeu_ps(p, v); }
+	YIN_YANG_TARGET_AVX512 static void store(int32_t* p, i32 v) { _mm512_storeu_si512(p, v); }
+
+	YIN_YANG_TARGET_AVX512 static mask_t tail_mask(int count) { return count <= 0 ? 0 : count >= 16 ? 0xFFFF : (mask_t)((1u << count) - 1); }
+	YIN_YANG_TARGET_AVX512 static f32 load(const float* p, mask_t m) { return _mm512_maskz_loadu_ps(m, p); }
+	YIN_YANG_TARGET_AVX512 static i32 load(const int32_t* p, mask_t m) { return _mm512_maskz_loadu_epi32(m, p); }
+	YIN_YANG_TARGET_AVX512 static void store(float* p, f32 v, mask_t m) { _mm512_mask_storeu_ps(p, m, v); }
+	YIN_YANG_TARGET_AVX512 static void store(int32_t* p, i32 v, mask_t m) { _mm512_mask_storeu_epi32(p, m, v); }
+
+	YIN_YANG_TARGET_AVX512 static f32 gather(const float* base, i32 index) { return _mm512_i32gather_ps(index, base, 4); }
+	YIN_YANG_TARGET_AVX512 static i32 gather(const int32_t* base, i32 index) { return _mm512_i32gather_epi32(index, base, 4); }
+	YIN_YANG_TARGET_AVX512 static void scatter(int32_t* base, i32 index, i32 v) { _mm512_i32scatter_epi32(base, index, v, 4); }
+
+	YIN_YANG_TARGET_AVX512 static f32 add(f32 a, f32 b) { return _mm512_add_ps(a, b); }
+	YIN_YANG_TARGET_AVX512 static f32 sub(f32 a, f32 b) { return _mm512_sub_ps(a, b); }
+	YIN_YANG_TARGET_AVX512 static f32 mul(f32 a, f32 b) { return _mm512_mul_ps(a, b); }
+	YIN_YANG_TARGET_AVX512 static f32 div(f32 a, f32 b) { return _mm512_div_ps(a, b); }
+	YIN_YANG_TARGET_AVX512 static f32 min(f32 a, f32 b) { return _mm512_min_ps(a, b); }
+	YIN_YANG_TARGET_AVX512 static f32 max(f32 a, f32 b) { return _mm512_max_ps(a, b); }
+	YIN_YANG_TARGET_AVX512 static f32 sqrt(f32 a) { return _mm512_sqrt_ps(a); }
+	YIN_YANG_TARGET_AVX512 static f32 floor(f32 a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+	YIN_YANG_TARGET_AVX512 static i32 cvtt(f32 a) { return _mm512_cvttps_epi32(a); }
+
+	// 14 bit estimate + one Newton step
+	YIN_YANG_TARGET_AVX512 static f32 rsqrt(f32 a) {
+		const f32 y = _mm512_rsqrt14_ps(a);
+		const f32 hay2 = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), a), _mm512_mul_ps(y, y));
+		return _mm512_mul_ps(y, _mm512_sub_ps(_mm512_set1_ps(1.5f), hay2));
+	}
+
+	YIN_YANG_TARGET_AVX512 static i32 add(i32 a, i32 b) { return _mm512_add_epi32(a, b); }
+	YIN_YANG_TARGET_AVX512 static i32 mullo(i32 a, i32 b) { return _mm512_mullo_epi32(a, b); }
+	YIN_YANG_TARGET_AVX512 static i32 bit_xor(i32 a, i32 b) { return _mm512_xor_si512(a, b); }
+	template<int r> YIN_YANG_TARGET_AVX512 static i32 shl(i32 a) { return _mm512_slli_epi32(a, r); }
+	template<int r> YIN_YANG_TARGET_AVX512 static i32 shr(i32 a) { return _mm512_srli_epi32(a, r); }
+	template<int r> YIN_YANG_TARGET_AVX512 static i32 rotl(i32 a) { return _mm512_rol_epi32(a, r); }
+
+	YIN_YANG_TARGET_AVX512 static mask_t cmp_lt(f32 a, f32 b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	YIN_YANG_TARGET_AVX512 static mask_t cmp_ge(f32 a, f32 b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	YIN_YANG_TARGET_AVX512 static mask_t mask_and(mask_t a, mask_t b) { return a & b; }
+	YIN_YANG_TARGET_AVX512 static f32 mask_zero(mask_t m, f32 a) { return _mm512_maskz_mov_ps(m, a); }
+	YIN_YANG_TARGET_AVX512 static int mask_count(mask_t m) { return std::popcount((uint32_t)m); }
+
+	YIN_YANG_TARGET_AVX512 static float hsum(f32 a) { return _mm512_reduce_add_ps(a); }
+	YIN_YANG_TARGET_AVX512 static float hmin(f32 a) { return _mm512_reduce_min_ps(a); }
+	YIN_YANG_TARGET_AVX512 static float hmax(f32 a) { return _mm512_reduce_max_ps(a); }
+};
+
+// a[i] += b[i], whole vectors then one masked tail
+template<class v_t>
+YIN_YANG_FORCE_INLINE void simd_add_kernel(float* a, const float* b, int count) {
+	int i = 0;
+	for (; i + v_t::lanes <= count; i += v_t::lanes) {
+		v_t::store(a + i, v_t::add(v_t::load(a + i), v_t::load(b + i)));
+	}
+	if (i < count) {
+		const auto mask = v_t::tail_mask(count - i);
+		v_t::store(a + i, v_t::add(v_t::load(a + i, mask), v_t::load(b + i, mask)), mask);
+	}
+}
+
+YIN_YANG_TARGET_AVX2 inline void simd_add_avx2(float* a, const float* b, int count) {
+	simd_add_kernel<simd_avx2_t>(a, b, count);
+}
+
+YIN_YANG_TARGET_AVX512 inline void simd_add_avx512(float* a, const float* b, int count) {
+	simd_add_kernel<simd_avx512_t>(a, b, count);
+}
+
+inline void simd_add(float* a, const float* b, int count) {
+	switch (simd_level()) {
+		case simd_level_t::Avx512:
+			simd_add_avx512(a, b, count);
+			break;
+		case simd_level_t::Avx2:
+			simd_add_avx2(a, b, count);
+			break;
+		default:
+			simd_add_kernel<simd_scalar_t>(a, b, count);
+			break;
+	}
+}
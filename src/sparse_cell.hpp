@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cassert>
+
 #include <simd.hpp>
 
 #include <glm/common.hpp>
@@ -10,11 +12,17 @@ inline constexpr int sparse_cell_base = 1 << 30;
 inline constexpr int sparse_cell_max = INT_MAX - 1;
 inline constexpr int sparse_cell_min = INT_MIN + 1;
 
-using sparse_cell_t = glm::ivec3;
 
+// cells are templated on dimension, planar scenes can use 2D cells end to end (hashing, conversion, neighbour stencils)
+template<int dim>
+using basic_sparse_cell_t = glm::vec<dim, int>;
+
+using sparse_cell_t = basic_sparse_cell_t<3>;
+using sparse_cell2d_t = basic_sparse_cell_t<2>;
+
+// hash choice depends on simd_level() (crc32 needs SSE4.2), level must stay fixed while hashed data is in use
 struct sparse_cell_hasher_t {
-#ifdef YIN_YANG_USE_SIMD
-	static uint32_t hcell_simd(const sparse_cell_t& cell) {
+	YIN_YANG_TARGET_AVX2 static uint32_t hcell_simd(const sparse_cell_t& cell) {
 		const __m128i load_mask = _mm_set_epi32(0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0);
 		const __m128i mul1 = _mm_set_epi32(0x85ebca6b, 0x85ebca6b, 0x85ebca6b, 0x85ebca6b);
 		const __m128i mul2 = _mm_set_epi32(0xc2b2ae35, 0xc2b2ae35, 0xc2b2ae35, 0xc2b2ae35);
@@ -34,18 +42,15 @@ struct sparse_cell_hasher_t {
 		return extracted[0] + extracted[1] + extracted[2];
 	}
 
-	static uint32_t hcell_crc32(const sparse_cell_t& cell) {
+	template<int dim>
+	YIN_YANG_TARGET_SSE42 static uint32_t hcell_crc32(const basic_sparse_cell_t<dim>& cell) {
 		uint32_t crc{};
-		crc = _mm_crc32_u32(crc, cell.x);
-		crc = _mm_crc32_u32(crc, cell.y);
-		crc = _mm_crc32_u32(crc, cell.z);
+		for (int i = 0; i < dim; i++) {
+			crc = _mm_crc32_u32(crc, cell[i]);
+		}
 		return crc;
 	}
 
-	static uint32_t hcell(const sparse_cell_t& cell) {
-		return hcell_crc32(cell); // seems to be the best and the fastest
-	}
-#else
 	static uint32_t h32(std::uint32_t h) {
 		h ^= (h >> 16);
 		h *= 0x85ebca6b;
@@ -55,28 +60,203 @@ struct sparse_cell_hasher_t {
 		return h;
 	}
 
-	static uint32_t hcell(const sparse_cell_t& cell) {
-		uint32_t x = h32(cell.x);
-		uint32_t y = h32(cell.y);
-		uint32_t z = h32(cell.z);
-		return (x * 0xc2b2ae35 + y) * 0x85ebca6b + z;
+	template<int dim>
+	static uint32_t hcell_scalar(const basic_sparse_cell_t<dim>& cell) {
+		constexpr uint32_t muls[] = {0xc2b2ae35, 0x85ebca6b};
+
+		uint32_t h = h32(cell[0]);
+		for (int i = 1; i < dim; i++) {
+			h = h * muls[i - 1] + h32(cell[i]);
+		}
+		return h;
+	}
+
+	template<int dim>
+	static uint32_t hcell(const basic_sparse_cell_t<dim>& cell) {
+		if (simd_level() >= simd_level_t::Sse42) {
+			return hcell_crc32(cell); // seems to be the best and the fastest
+		}
+		return hcell_scalar(cell);
+	}
+
+	template<int dim>
+	uint32_t operator() (const basic_sparse_cell_t<dim>& cell) const {
+		return hcell(cell);
+	}
+};
+
+// murmur3 (32 bit, 12 byte key, 8 byte for 2D cells) over cell components, same operations in every lane so it vectorizes to full width
+// scalar and batch versions share one kernel and produce identical hashes (on every simd level),
+// so batch hashed keys can be looked up with scalar hashed ones
+namespace sparse_cell_mix {
+	inline constexpr int32_t c1 = (int32_t)0xcc9e2d51;
+	inline constexpr int32_t c2 = (int32_t)0x1b873593;
+	inline constexpr int32_t m = (int32_t)0xe6546b64;
+	inline constexpr int32_t f1 = (int32_t)0x85ebca6b;
+	inline constexpr int32_t f2 = (int32_t)0xc2b2ae35;
+
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE typename v_t::i32 step(typename v_t::i32 h, typename v_t::i32 k) {
+		k = v_t::mullo(k, v_t::set1(c1));
+		k = v_t::template rotl<15>(k);
+		k = v_t::mullo(k, v_t::set1(c2));
+		h = v_t::bit_xor(h, k);
+		h = v_t::template rotl<13>(h);
+		return v_t::add(v_t::add(v_t::template shl<2>(h), h), v_t::set1(m)); // h * 5 + m
+	}
+
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE typename v_t::i32 hash_lanes(typename v_t::i32 x, typename v_t::i32 y, typename v_t::i32 z) {
+		typename v_t::i32 h = v_t::zero_i32();
+		h = step<v_t>(h, x);
+		h = step<v_t>(h, y);
+		h = step<v_t>(h, z);
+		h = v_t::bit_xor(h, v_t::set1((int32_t)12));
+		h = v_t::bit_xor(h, v_t::template shr<16>(h));
+		h = v_t::mullo(h, v_t::set1(f1));
+		h = v_t::bit_xor(h, v_t::template shr<13>(h));
+		h = v_t::mullo(h, v_t::set1(f2));
+		h = v_t::bit_xor(h, v_t::template shr<16>(h));
+		return h;
+	}
+
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE typename v_t::i32 hash_lanes(typename v_t::i32 x, typename v_t::i32 y) {
+		typename v_t::i32 h = v_t::zero_i32();
+		h = step<v_t>(h, x);
+		h = step<v_t>(h, y);
+		h = v_t::bit_xor(h, v_t::set1((int32_t)8));
+		h = v_t::bit_xor(h, v_t::template shr<16>(h));
+		h = v_t::mullo(h, v_t::set1(f1));
+		h = v_t::bit_xor(h, v_t::template shr<13>(h));
+		h = v_t::mullo(h, v_t::set1(f2));
+		h = v_t::bit_xor(h, v_t::template shr<16>(h));
+		return h;
+	}
+
+	inline uint32_t hash(int32_t x, int32_t y, int32_t z) {
+		return (uint32_t)hash_lanes<simd_scalar_t>(x, y, z);
+	}
+
+	inline uint32_t hash(int32_t x, int32_t y) {
+		return (uint32_t)hash_lanes<simd_scalar_t>(x, y);
+	}
+
+	// kernels process whole vectors only and return count of processed cells, caller finishes the tail
+	template<class v_t, int dim>
+	YIN_YANG_FORCE_INLINE uint32_t hash_many_kernel(const int32_t* data, uint32_t count, uint32_t* out) {
+		const typename v_t::i32 index = v_t::lane_index(dim);
+		uint32_t i = 0;
+		for (; i + v_t::lanes <= count; i += v_t::lanes) {
+			const int32_t* base = data + dim * i;
+			const typename v_t::i32 x = v_t::gather(base + 0, index);
+			const typename v_t::i32 y = v_t::gather(base + 1, index);
+			if constexpr (dim == 2) {
+				v_t::store((int32_t*)(out + i), hash_lanes<v_t>(x, y));
+			} else {
+				v_t::store((int32_t*)(out + i), hash_lanes<v_t>(x, y, v_t::gather(base + 2, index)));
+			}
+		}
+		return i;
 	}
-#endif
 
-	uint32_t operator() (const sparse_cell_t& cell) const {
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE uint32_t hash_many_kernel(const int32_t* xs, const int32_t* ys, const int32_t* zs, uint32_t count, uint32_t* out) {
+		uint32_t i = 0;
+		for (; i + v_t::lanes <= count; i += v_t::lanes) {
+			v_t::store((int32_t*)(out + i), hash_lanes<v_t>(v_t::load(xs + i), v_t::load(ys + i), v_t::load(zs + i)));
+		}
+		return i;
+	}
+
+	template<int dim>
+	YIN_YANG_TARGET_AVX2 inline uint32_t hash_many8(const int32_t* data, uint32_t count, uint32_t* out) {
+		return hash_many_kernel<simd_avx2_t, dim>(data, count, out);
+	}
+
+	template<int dim>
+	YIN_YANG_TARGET_AVX512 inline uint32_t hash_many16(const int32_t* data, uint32_t count, uint32_t* out) {
+		return hash_many_kernel<simd_avx512_t, dim>(data, count, out);
+	}
+
+	YIN_YANG_TARGET_AVX2 inline uint32_t hash_many8(const int32_t* xs, const int32_t* ys, const int32_t* zs, uint32_t count, uint32_t* out) {
+		return hash_many_kernel<simd_avx2_t>(xs, ys, zs, count, out);
+	}
+
+	YIN_YANG_TARGET_AVX512 inline uint32_t hash_many16(const int32_t* xs, const int32_t* ys, const int32_t* zs, uint32_t count, uint32_t* out) {
+		return hash_many_kernel<simd_avx512_t>(xs, ys, zs, count, out);
+	}
+}
+
+// hasher that has batch versions, see sparse_cell_hash_many
+struct sparse_cell_mix_hasher_t {
+	template<int dim>
+	static uint32_t hcell(const basic_sparse_cell_t<dim>& cell) {
+		if constexpr (dim == 2) {
+			return sparse_cell_mix::hash(cell.x, cell.y);
+		} else {
+			return sparse_cell_mix::hash(cell.x, cell.y, cell.z);
+		}
+	}
+
+	template<int dim>
+	uint32_t operator() (const basic_sparse_cell_t<dim>& cell) const {
 		return hcell(cell);
 	}
 };
 
+// batch hashing (AoS), out[i] = sparse_cell_mix_hasher_t::hcell(cells[i])
+// 16 cells per iteration with AVX-512, 8 with AVX2, scalar tail
+template<int dim>
+inline void sparse_cell_hash_many(const basic_sparse_cell_t<dim>* cells, uint32_t count, uint32_t* out) {
+	static_assert(sizeof(basic_sparse_cell_t<dim>) == dim * sizeof(int), "cells must be tightly packed");
+
+	const int* data = glm::value_ptr(cells[0]);
+
+	uint32_t i = 0;
+	switch (simd_level()) {
+		case simd_level_t::Avx512:
+			i = sparse_cell_mix::hash_many16<dim>(data, count, out);
+			break;
+		case simd_level_t::Avx2:
+			i = sparse_cell_mix::hash_many8<dim>(data, count, out);
+			break;
+		default:
+			break;
+	}
+	for (; i < count; i++) {
+		out[i] = sparse_cell_mix_hasher_t::hcell(cells[i]);
+	}
+}
+
+// batch hashing (SoA), out[i] = hash of cell {xs[i], ys[i], zs[i]}
+inline void sparse_cell_hash_many(const int* xs, const int* ys, const int* zs, uint32_t count, uint32_t* out) {
+	uint32_t i = 0;
+	switch (simd_level()) {
+		case simd_level_t::Avx512:
+			i = sparse_cell_mix::hash_many16(xs, ys, zs, count, out);
+			break;
+		case simd_level_t::Avx2:
+			i = sparse_cell_mix::hash_many8(xs, ys, zs, count, out);
+			break;
+		default:
+			break;
+	}
+	for (; i < count; i++) {
+		out[i] = sparse_cell_mix::hash(xs[i], ys[i], zs[i]);
+	}
+}
+
 struct sparse_cell_equals_t {
-	bool operator() (const sparse_cell_t& cell1, const sparse_cell_t& cell2) const {
+	template<int dim>
+	bool operator() (const basic_sparse_cell_t<dim>& cell1, const basic_sparse_cell_t<dim>& cell2) const {
 		return cell1 == cell2;
 	}
 };
 
 
-#ifdef YIN_YANG_USE_SIMD
-inline sparse_cell_t __get_sparse_cell(const glm::vec3& point, float cell_scale) {
+template<int dim>
+inline basic_sparse_cell_t<dim> __get_sparse_cell(const glm::vec<dim, float>& point, float cell_scale) {
 	/*const __m128i load_store_mask = _mm_set_epi32(0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0);
 	const __m128 pmin = _mm_set_ps((float)sparse_cell_min, (float)sparse_cell_min, (float)sparse_cell_min, (float)sparse_cell_min);
 	const __m128 pmax = _mm_set_ps((float)sparse_cell_max, (float)sparse_cell_max, (float)sparse_cell_max, (float)sparse_cell_max);
@@ -89,16 +269,161 @@ inline sparse_cell_t __get_sparse_cell(const glm::vec3& point, float cell_scale)
 	_mm_maskstore_epi32(glm::value_ptr(cell), load_store_mask, c);
 	return cell;*/
 
-	// simple version seems to work better
-	return glm::clamp(glm::floor(point * cell_scale), glm::vec3(sparse_cell_min), glm::vec3(sparse_cell_max));
-}
-#else
-inline sparse_cell_t __get_sparse_cell(const glm::vec3& point, float cell_scale) {
-	return glm::clamp(glm::floor(point * cell_scale), glm::vec3(sparse_cell_min), glm::vec3(sparse_cell_max));
+	// simple version seems to work better (for single points, see get_sparse_cells)
+	using vec_t = glm::vec<dim, float>;
+	return basic_sparse_cell_t<dim>(glm::clamp(glm::floor(point * cell_scale), vec_t(sparse_cell_min), vec_t(sparse_cell_max)));
 }
-#endif
 
 // cell_scale = 1.0f / cell_size
-inline sparse_cell_t get_sparse_cell(const glm::vec3& point, float cell_scale) {
+template<int dim>
+inline basic_sparse_cell_t<dim> get_sparse_cell(const glm::vec<dim, float>& point, float cell_scale) {
 	return __get_sparse_cell(point, cell_scale);
+}
+
+// cell of the grid with 2^level times larger cells that contains the given one
+// same as get_sparse_cell(point, cell_scale / 2^level) as scaling by a power of two is exact, shift floors negative indices too
+template<int dim>
+inline basic_sparse_cell_t<dim> coarsen_sparse_cell(const basic_sparse_cell_t<dim>& cell, int level) {
+	basic_sparse_cell_t<dim> coarse{};
+	for (int i = 0; i < dim; i++) {
+		coarse[i] = cell[i] >> level;
+	}
+	return coarse;
+}
+
+// bulk conversion: multiply, floor, clamp, convert and (optionally) hash 16 points per iteration with AVX-512, 8 with AVX2
+// results are the same as get_sparse_cell & sparse_cell_mix_hasher_t for every point
+namespace sparse_cell_bulk {
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE typename v_t::i32 convert(typename v_t::f32 p, typename v_t::f32 scale) {
+		p = v_t::floor(v_t::mul(p, scale));
+		p = v_t::max(v_t::set1((float)sparse_cell_min), v_t::min(v_t::set1((float)sparse_cell_max), p));
+		return v_t::cvtt(p);
+	}
+
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE void store(sparse_cell_t* cells, uint32_t* hashes, typename v_t::i32 x, typename v_t::i32 y, typename v_t::i32 z) {
+		const typename v_t::i32 index = v_t::lane_index(3);
+		int32_t* base = glm::value_ptr(cells[0]);
+		v_t::scatter(base + 0, index, x);
+		v_t::scatter(base + 1, index, y);
+		v_t::scatter(base + 2, index, z);
+		if (hashes) {
+			v_t::store((int32_t*)hashes, sparse_cell_mix::hash_lanes<v_t>(x, y, z));
+		}
+	}
+
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE void store(sparse_cell2d_t* cells, uint32_t* hashes, typename v_t::i32 x, typename v_t::i32 y) {
+		const typename v_t::i32 index = v_t::lane_index(2);
+		int32_t* base = glm::value_ptr(cells[0]);
+		v_t::scatter(base + 0, index, x);
+		v_t::scatter(base + 1, index, y);
+		if (hashes) {
+			v_t::store((int32_t*)hashes, sparse_cell_mix::hash_lanes<v_t>(x, y));
+		}
+	}
+
+	// kernels process whole vectors only and return count of processed points, caller finishes the tail
+	template<class v_t, int dim>
+	YIN_YANG_FORCE_INLINE uint32_t convert_many_kernel(const float* data, uint32_t step, uint32_t count, float cell_scale, basic_sparse_cell_t<dim>* cells, uint32_t* hashes) {
+		const typename v_t::f32 scale = v_t::set1(cell_scale);
+		const typename v_t::i32 index = v_t::lane_index(step);
+		uint32_t i = 0;
+		for (; i + v_t::lanes <= count; i += v_t::lanes) {
+			const float* base = data + (size_t)i * step;
+			const typename v_t::i32 x = convert<v_t>(v_t::gather(base + 0, index), scale);
+			const typename v_t::i32 y = convert<v_t>(v_t::gather(base + 1, index), scale);
+			if constexpr (dim == 2) {
+				store<v_t>(cells + i, hashes ? hashes + i : nullptr, x, y);
+			} else {
+				const typename v_t::i32 z = convert<v_t>(v_t::gather(base + 2, index), scale);
+				store<v_t>(cells + i, hashes ? hashes + i : nullptr, x, y, z);
+			}
+		}
+		return i;
+	}
+
+	template<class v_t>
+	YIN_YANG_FORCE_INLINE uint32_t convert_many_kernel(const float* xs, const float* ys, const float* zs, uint32_t count, float cell_scale, sparse_cell_t* cells, uint32_t* hashes) {
+		const typename v_t::f32 scale = v_t::set1(cell_scale);
+		uint32_t i = 0;
+		for (; i + v_t::lanes <= count; i += v_t::lanes) {
+			const typename v_t::i32 x = convert<v_t>(v_t::load(xs + i), scale);
+			const typename v_t::i32 y = convert<v_t>(v_t::load(ys + i), scale);
+			const typename v_t::i32 z = convert<v_t>(v_t::load(zs + i), scale);
+			store<v_t>(cells + i, hashes ? hashes + i : nullptr, x, y, z);
+		}
+		return i;
+	}
+
+	template<int dim>
+	YIN_YANG_TARGET_AVX2 inline uint32_t convert_many8(const float* data, uint32_t step, uint32_t count, float cell_scale, basic_sparse_cell_t<dim>* cells, uint32_t* hashes) {
+		return convert_many_kernel<simd_avx2_t, dim>(data, step, count, cell_scale, cells, hashes);
+	}
+
+	template<int dim>
+	YIN_YANG_TARGET_AVX512 inline uint32_t convert_many16(const float* data, uint32_t step, uint32_t count, float cell_scale, basic_sparse_cell_t<dim>* cells, uint32_t* hashes) {
+		return convert_many_kernel<simd_avx512_t, dim>(data, step, count, cell_scale, cells, hashes);
+	}
+
+	YIN_YANG_TARGET_AVX2 inline uint32_t convert_many8(const float* xs, const float* ys, const float* zs, uint32_t count, float cell_scale, sparse_cell_t* cells, uint32_t* hashes) {
+		return convert_many_kernel<simd_avx2_t>(xs, ys, zs, count, cell_scale, cells, hashes);
+	}
+
+	YIN_YANG_TARGET_AVX512 inline uint32_t convert_many16(const float* xs, const float* ys, const float* zs, uint32_t count, float cell_scale, sparse_cell_t* cells, uint32_t* hashes) {
+		return convert_many_kernel<simd_avx512_t>(xs, ys, zs, count, cell_scale, cells, hashes);
+	}
+}
+
+// AoS version, points are read with stride (in bytes) so vec member of a larger record can be used directly
+// if hashes is not null hashes are computed while cells are still in registers
+template<int dim>
+inline void get_sparse_cells(const glm::vec<dim, float>* points, uint32_t count, float cell_scale, basic_sparse_cell_t<dim>* cells,
+	uint32_t* hashes = nullptr, uint32_t stride = sizeof(glm::vec<dim, float>)) {
+	assert(stride % sizeof(float) == 0);
+
+	const float* data = glm::value_ptr(points[0]);
+	const uint32_t step = stride / sizeof(float);
+
+	uint32_t i = 0;
+	switch (simd_level()) {
+		case simd_level_t::Avx512:
+			i = sparse_cell_bulk::convert_many16<dim>(data, step, count, cell_scale, cells, hashes);
+			break;
+		case simd_level_t::Avx2:
+			i = sparse_cell_bulk::convert_many8<dim>(data, step, count, cell_scale, cells, hashes);
+			break;
+		default:
+			break;
+	}
+	for (; i < count; i++) {
+		const glm::vec<dim, float>& point = *(const glm::vec<dim, float>*)(data + (size_t)i * step);
+		cells[i] = get_sparse_cell(point, cell_scale);
+		if (hashes) {
+			hashes[i] = sparse_cell_mix_hasher_t::hcell(cells[i]);
+		}
+	}
+}
+
+// SoA version
+inline void get_sparse_cells(const float* xs, const float* ys, const float* zs, uint32_t count, float cell_scale, sparse_cell_t* cells,
+	uint32_t* hashes = nullptr) {
+	uint32_t i = 0;
+	switch (simd_level()) {
+		case simd_level_t::Avx512:
+			i = sparse_cell_bulk::convert_many16(xs, ys, zs, count, cell_scale, cells, hashes);
+			break;
+		case simd_level_t::Avx2:
+			i = sparse_cell_bulk::convert_many8(xs, ys, zs, count, cell_scale, cells, hashes);
+			break;
+		default:
+			break;
+	}
+	for (; i < count; i++) {
+		cells[i] = get_sparse_cell(glm::vec3{xs[i], ys[i], zs[i]}, cell_scale);
+		if (hashes) {
+			hashes[i] = sparse_cell_mix_hasher_t::hcell(cells[i]);
+		}
+	}
 }
\ No newline at end of file
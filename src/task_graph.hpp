@@ -0,0 +1,241 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+#include <functional>
+
+#include "thread_pool.hpp"
+
+// named data (system state, components, buffers, GL context, ...) a task reads or writes
+// two tasks conflict if one of them writes anything the other one reads or writes
+struct task_access_t {
+	bool conflicts(const task_access_t& other) const {
+		auto intersects = [] (const std::vector<std::string>& a, const std::vector<std::string>& b) {
+			for (auto& name : a) {
+				if (std::find(b.begin(), b.end(), name) != b.end()) {
+					return true;
+				}
+			}
+			return false;
+		};
+		return intersects(writes, other.reads) || intersects(writes, other.writes) || intersects(reads, other.writes);
+	}
+
+	void merge(const task_access_t& other) {
+		reads.insert(reads.end(), other.reads.begin(), other.reads.end());
+		writes.insert(writes.end(), other.writes.begin(), other.writes.end());
+		main_thread |= other.main_thread;
+	}
+
+	std::vector<std::string> reads;
+	std::vector<std::string> writes;
+	bool main_thread{}; // must be executed by the thread that calls execute()
+};
+
+// per frame task graph
+// tasks are added in program order, task depends on every earlier task it conflicts with (so insertion order is a topological order)
+// execute() runs main thread tasks on the calling thread, other tasks are pushed into the pool as soon as their dependencies are done
+// after execute() stats hold timings of the frame & its critical path (longest chain of dependent tasks by measured time)
+struct task_graph_t {
+	using clock_t = std::chrono::steady_clock;
+	using task_func_t = std::function<void()>;
+
+	static constexpr uint32_t max_tasks_log2 = 8;
+	static constexpr int max_tasks = 1 << max_tasks_log2;
+
+	struct task_t : public job_if_t {
+		// worker
+		void execute() override {
+			graph->run_task(id);
+		}
+
+		task_graph_t* graph{};
+		int id{};
+
+		std::string name;
+		task_access_t access;
+		task_func_t func;
+
+		std::vector<int> predecessors;
+		std::vector<int> successors;
+		std::atomic<int> pending_predecessors{};
+
+		clock_t::time_point start{};
+		clock_t::time_point stop{};
+	};
+
+	// all times are in milliseconds since the start of execute()
+	struct stats_t {
+		std::vector<double> start;
+		std::vector<double> stop;
+		std::vector<int> critical_path;
+		double critical_path_time{};
+		double frame_time{};
+	};
+
+	task_graph_t() = default;
+
+	task_graph_t(const task_graph_t&) = delete;
+	task_graph_t& operator= (const task_graph_t&) = delete;
+
+	// master, graph must not be executing
+	int add_task(std::string name, task_access_t access, task_func_t func) {
+		assert(tasks.size() < max_tasks);
+
+		auto task = std::make_unique<task_t>();
+		task->graph = this;
+		task->id = tasks.size();
+		task->name = std::move(name);
+		task->access = std::move(access);
+		task->func = std::move(func);
+		for (auto& prev : tasks) {
+			if (prev->access.conflicts(task->access)) {
+				task->predecessors.push_back(prev->id);
+				prev->successors.push_back(task->id);
+			}
+		}
+		tasks.push_back(std::move(task));
+		return tasks.back()->id;
+	}
+
+	// master, parallel == false executes all tasks in program order on the calling thread
+	void execute(thread_pool_t& _pool, bool parallel = true) {
+		pool = &_pool;
+		frame_start = clock_t::now();
+
+		if (parallel) {
+			remaining.store(tasks.size(), std::memory_order_relaxed);
+			for (auto& task : tasks) {
+				task->pending_predecessors.store(task->predecessors.size(), std::memory_order_relaxed);
+			}
+			for (auto& task : tasks) {
+				if (task->predecessors.empty()) {
+					make_ready(task->id);
+				}
+			}
+
+			while (true) {
+				const uint32_t epoch = main_epoch.load(std::memory_order_acquire);
+				if (int id{}; main_ready.pop(id)) {
+					run_task(id);
+					continue;
+				}
+				if (remaining.load(std::memory_order_acquire) == 0) {
+					break;
+				}
+				main_epoch.wait(epoch, std::memory_order_acquire);
+			}
+			group.wait(); // pool must be done with the task jobs before they can be pushed again
+		} else {
+			for (auto& task : tasks) {
+				task->start = clock_t::now();
+				task->func();
+				task->stop = clock_t::now();
+			}
+		}
+
+		update_stats();
+	}
+
+	// mt function
+	void make_ready(int id) {
+		task_t& task = *tasks[id];
+		if (task.access.main_thread) {
+			[[maybe_unused]] const bool pushed = main_ready.push(id);
+			assert(pushed);
+			wake_main();
+		} else {
+			pool->push_job(&task, &group);
+		}
+	}
+
+	// mt function
+	void run_task(int id) {
+		task_t& task = *tasks[id];
+		task.start = clock_t::now();
+		task.func();
+		task.stop = clock_t::now();
+
+		for (int succ : task.successors) {
+			if (tasks[succ]->pending_predecessors.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				make_ready(succ);
+			}
+		}
+		if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			wake_main();
+		}
+	}
+
+	void wake_main() {
+		main_epoch.fetch_add(1, std::memory_order_release);
+		main_epoch.notify_one();
+	}
+
+	// master
+	void update_stats() {
+		auto to_ms = [&] (clock_t::time_point time) {
+			return std::chrono::duration<double, std::milli>(time - frame_start).count();
+		};
+
+		const int count = tasks.size();
+		stats.start.resize(count);
+		stats.stop.resize(count);
+		stats.critical_path.clear();
+		stats.critical_path_time = 0.0;
+		stats.frame_time = 0.0;
+
+		std::vector<double> finish(count);
+		std::vector<int> critical_prev(count, -1);
+		int last = -1;
+		for (int i = 0; i < count; i++) {
+			stats.start[i] = to_ms(tasks[i]->start);
+			stats.stop[i] = to_ms(tasks[i]->stop);
+			stats.frame_time = std::max(stats.frame_time, stats.stop[i]);
+
+			double ready = 0.0;
+			for (int pred : tasks[i]->predecessors) {
+				if (finish[pred] > ready) {
+					ready = finish[pred];
+					critical_prev[i] = pred;
+				}
+			}
+			finish[i] = ready + (stats.stop[i] - stats.start[i]);
+			if (last == -1 || finish[i] > finish[last]) {
+				last = i;
+			}
+		}
+
+		for (int i = last; i != -1; i = critical_prev[i]) {
+			stats.critical_path.push_back(i);
+		}
+		std::reverse(stats.critical_path.begin(), stats.critical_path.end());
+		stats.critical_path_time = last != -1 ? finish[last] : 0.0;
+	}
+
+	int task_count() const {
+		return tasks.size();
+	}
+
+	const task_t& get_task(int id) const {
+		return *tasks[id];
+	}
+
+	const stats_t& get_stats() const {
+		return stats;
+	}
+
+	std::vector<std::unique_ptr<task_t>> tasks;
+
+	thread_pool_t* pool{};
+	job_group_t group;
+	mpmc_ring_t<int> main_ready{max_tasks_log2};
+	std::atomic<uint32_t> main_epoch{};
+	std::atomic<int> remaining{};
+
+	clock_t::time_point frame_start{};
+	stats_t stats{};
+};
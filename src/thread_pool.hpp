@@ -1,36 +1,150 @@
 #pragma once
 
-#include <queue>
+#include <span>
+#include <deque>
 #include <mutex>
+#include <memory>
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <cstdint>
+#include <algorithm>
 #include <condition_variable>
 
+#include <immintrin.h>
+
+#include "cpu_topology.hpp"
+
+// bounded lock-free multi producer multi consumer ring (sequence per cell, see Vyukov's bounded mpmc queue)
+// cell is free for position pos if its sequence == pos and holds data of position pos if its sequence == pos + 1
+// bulk ops claim a run of consecutive ready cells with a single CAS, so they may push / pop less than requested
 template<class data_t>
-struct mt_queue_t {
-	template<class _data_t>
-	void push(_data_t&& data) {
-		std::unique_lock lock_guard{lock};
-		queue.push(std::forward<_data_t>(data));
-		added.notify_one();
+struct mpmc_ring_t {
+	struct alignas(64) cell_t {
+		std::atomic<uint64_t> sequence{};
+		data_t data{};
+	};
+
+	mpmc_ring_t(uint32_t capacity_log2 = 10)
+		: capacity{1ull << capacity_log2}
+		, mask{capacity - 1}
+		, cells{std::make_unique<cell_t[]>(capacity)} {
+		for (uint64_t i = 0; i < capacity; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
 	}
 
-	data_t pop() {
-		std::unique_lock lock_guard{lock};
-		if (queue.empty()) {
-			added.wait(lock_guard, [&] (){
-				return !queue.empty();
-			});
+	// returns count of pushed items, data[0, pushed) is enqueued in order
+	int push_bulk(const data_t* data, int count) {
+		uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		while (true) {
+			int ready = 0;
+			while (ready < count && cells[(pos + ready) & mask].sequence.load(std::memory_order_acquire) == pos + ready) {
+				ready++;
+			}
+			if (ready == 0) {
+				const uint64_t seq = cells[pos & mask].sequence.load(std::memory_order_acquire);
+				if ((int64_t)(seq - pos) < 0) {
+					return 0; // full: cell still holds data of the previous lap
+				}
+				pos = enqueue_pos.load(std::memory_order_relaxed); // somebody claimed it already
+				continue;
+			}
+			if (enqueue_pos.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed)) {
+				for (int i = 0; i < ready; i++) {
+					cell_t& cell = cells[(pos + i) & mask];
+					cell.data = data[i];
+					cell.sequence.store(pos + i + 1, std::memory_order_release);
+				}
+				return ready;
+			}
 		}
-		data_t data = std::move(queue.front());
-		queue.pop();
-		return data;
 	}
 
-	std::mutex lock;
-	std::condition_variable added;
-	std::queue<data_t> queue;
+	// returns count of popped items, at most count
+	int pop_bulk(data_t* data, int count) {
+		uint64_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		while (true) {
+			int ready = 0;
+			while (ready < count && cells[(pos + ready) & mask].sequence.load(std::memory_order_acquire) == pos + ready + 1) {
+				ready++;
+			}
+			if (ready == 0) {
+				const uint64_t seq = cells[pos & mask].sequence.load(std::memory_order_acquire);
+				if ((int64_t)(seq - (pos + 1)) < 0) {
+					return 0; // empty or producer hasn't finished writing yet
+				}
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+				continue;
+			}
+			if (dequeue_pos.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed)) {
+				for (int i = 0; i < ready; i++) {
+					cell_t& cell = cells[(pos + i) & mask];
+					data[i] = std::move(cell.data);
+					cell.sequence.store(pos + i + capacity, std::memory_order_release);
+				}
+				return ready;
+			}
+		}
+	}
+
+	bool push(const data_t& data) {
+		return push_bulk(&data, 1) == 1;
+	}
+
+	bool pop(data_t& data) {
+		return pop_bulk(&data, 1) == 1;
+	}
+
+	const uint64_t capacity{};
+	const uint64_t mask{};
+	std::unique_ptr<cell_t[]> cells;
+	alignas(64) std::atomic<uint64_t> enqueue_pos{};
+	alignas(64) std::atomic<uint64_t> dequeue_pos{};
+};
+
+struct thread_pool_t;
+
+// completion counter for a set of jobs: one atomic countdown instead of a mutex & condvar per job
+// waiting thread helps the pool, then spins for a while and then parks on the counter
+// jobs pushed into a group don't signal job_if_t::wait, the group is the only way to wait for them
+struct alignas(64) job_group_t {
+	static constexpr int spin_count = 4096;
+
+	job_group_t() = default;
+
+	job_group_t(const job_group_t&) = delete;
+	job_group_t& operator= (const job_group_t&) = delete;
+
+	// waiter sets parked bit before it parks, so the last job knows if it must wake anybody
+	// waiter may destroy the group right after wait returns, so if the last job saw the parked bit
+	// the waiter doesn't return until that job acknowledges (released) that it is done with notify
+	static constexpr uint32_t parked_bit = 1u << 31;
+	static constexpr uint32_t count_mask = parked_bit - 1;
+
+	void add(int count) {
+		pending.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// last job wakes parked waiter, store to released is its last access to the group
+	void done() {
+		const uint32_t prev = pending.fetch_sub(1, std::memory_order_acq_rel);
+		if ((prev & count_mask) == 1 && (prev & parked_bit)) {
+			pending.notify_all();
+			released.store(true, std::memory_order_release);
+		}
+	}
+
+	bool finished() const {
+		return (pending.load(std::memory_order_acquire) & count_mask) == 0;
+	}
+
+	// one waiter at a time, group can be reused after wait returns
+	void wait();
+
+	std::atomic<uint32_t> pending{};
+	std::atomic<bool> released{};
+	thread_pool_t* pool{}; // set by push_job
 };
 
 struct job_if_t {
@@ -47,21 +161,18 @@ struct job_if_t {
 
 	void set_ready() {
 		std::unique_lock lock_guard{lock};
-		ready_status = true;
+		ready_status.store(true, std::memory_order_release);
 		ready.notify_all();
 	}
 
-	void wait() {
-		std::unique_lock lock_guard{lock};
-		ready.wait(lock_guard, [&] (){
-			return ready_status;
-		});
-		ready_status = false;
-	}
+	// waiting thread executes pending jobs of the pool the job was pushed to until the job is done
+	void wait();
 
 	std::mutex lock;
 	std::condition_variable ready;
-	bool ready_status{};
+	std::atomic<bool> ready_status{};
+	thread_pool_t* pool{}; // set by push_job
+	job_group_t* group{}; // set by push_job
 };
 
 template<class func_t>
@@ -81,69 +192,508 @@ struct func_job_t : public job_if_t {
 template<class func_t>
 func_job_t(func_t&& func) -> func_job_t<func_t>;
 
-// very simple thread pool
+// executes callable owned by somebody else, used by parallel loops
+template<class func_t>
+struct ref_job_t : public job_if_t {
+	void execute() override {
+		(*func)();
+	}
+
+	func_t* func{};
+};
+
+// reusable barrier for a fixed set of resident threads passing between phases of a multi-phase parallel loop
+// waiting thread spins for a while and then parks on the generation counter
+// everything written before arrive_and_wait is visible to every participant after it returns
+struct alignas(64) phase_barrier_t {
+	static constexpr int spin_count = 4096;
+
+	phase_barrier_t(int _count = 1)
+		: count{_count}
+	{}
+
+	// must not be called while any participant is inside arrive_and_wait
+	void reset(int _count) {
+		count = _count;
+		arrived.store(0, std::memory_order_relaxed);
+	}
+
+	void arrive_and_wait() {
+		const uint32_t gen = generation.load(std::memory_order_acquire);
+		if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+			arrived.store(0, std::memory_order_relaxed);
+			generation.store(gen + 1, std::memory_order_seq_cst);
+			if (parked.load(std::memory_order_seq_cst) > 0) {
+				generation.notify_all();
+			}
+			return;
+		}
+
+		for (int i = 0; i < spin_count; i++) {
+			if (generation.load(std::memory_order_acquire) != gen) {
+				return;
+			}
+			_mm_pause();
+		}
+
+		parked.fetch_add(1, std::memory_order_seq_cst);
+		while (generation.load(std::memory_order_seq_cst) == gen) {
+			generation.wait(gen, std::memory_order_acquire);
+		}
+		parked.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	int count{};
+	std::atomic<int> arrived{};
+	std::atomic<uint32_t> generation{};
+	std::atomic<int> parked{};
+};
+
+// per worker job deque: owner pushes & pops at the back (LIFO, cache warm), thieves steal from the front
+struct alignas(64) work_deque_t {
+	void push(job_if_t* job) {
+		std::unique_lock lock_guard{lock};
+		jobs.push_back(job);
+	}
+
+	void push_bulk(std::span<job_if_t* const> _jobs) {
+		std::unique_lock lock_guard{lock};
+		jobs.insert(jobs.end(), _jobs.begin(), _jobs.end());
+	}
+
+	job_if_t* pop() {
+		std::unique_lock lock_guard{lock};
+		if (jobs.empty()) {
+			return nullptr;
+		}
+		job_if_t* job = jobs.back();
+		jobs.pop_back();
+		return job;
+	}
+
+	job_if_t* steal() {
+		std::unique_lock lock_guard{lock};
+		if (jobs.empty()) {
+			return nullptr;
+		}
+		job_if_t* job = jobs.front();
+		jobs.pop_front();
+		return job;
+	}
+
+	std::mutex lock;
+	std::deque<job_if_t*> jobs;
+};
+
+struct thread_pool_settings_t {
+	int thread_count{}; // <= 0 - default worker count of the detected topology
+	bool use_smt{}; // default worker count includes SMT siblings
+	bool pin_workers{}; // every worker is restricted to its own cpu (see cpu_topology_t::worker_cpus())
+	bool reserve_master_core{true}; // workers keep off the first core, the thread creating the pool is pinned there if pin_workers is set (its previous affinity is restored when the pool is destroyed)
+};
+
+// work stealing thread pool
 // you submit some set of jobs
-// you wait for them
+// you wait for them (waiting thread helps to execute queued jobs)
 // you cannot drop thread jobs
 // you'd better not push the same job more then once (so only one thread can execute the job)
-// you are not allowed to push nullptr: it is a special value that will terminate a worker
+// you are not allowed to push nullptr
+// - jobs pushed from outside go into a shared lock-free ring (one enqueue per push_jobs), overflow is distributed round robin
+// - every worker owns a deque, jobs pushed from a worker go to its own deque
+// - idle worker steals from random victims, spins for a while and then parks until new job is pushed
 struct thread_pool_t {
 	static constexpr int thread_count_fallback = 8;
+	static constexpr int idle_spins = 256; // failed steal rounds before worker parks or waiting thread blocks
+	static constexpr uint32_t injected_capacity_log2 = 10;
+
+	thread_pool_t(int thread_count = 0) : thread_pool_t(thread_pool_settings_t{.thread_count = thread_count}) {}
 
-	thread_pool_t(int thread_count = 0) {
+	thread_pool_t(const thread_pool_settings_t& _settings) : settings{_settings}, topology{cpu_topology_t::detect()} {
+		int thread_count = settings.thread_count;
 		if (thread_count <= 0) {
-			thread_count = thread_count_fallback;
+			thread_count = topology.logical_count() > 0
+				? topology.default_worker_count(settings.use_smt, settings.reserve_master_core)
+				: thread_count_fallback;
 		}
+
+		if (settings.pin_workers) {
+			worker_cpus = topology.worker_cpus(thread_count, settings.reserve_master_core);
+			if (settings.reserve_master_core) {
+				master_prev_cpus = current_thread_cpus();
+				master_pinned = !master_prev_cpus.empty() && pin_current_thread(topology.master_cpus());
+			}
+		}
+
+		deques = std::make_unique<work_deque_t[]>(thread_count);
 		for (int i = 0; i < thread_count; i++) {
-			workers.push_back(std::thread([&]() {
-				thread_pool_worker_func();
+			workers.push_back(std::thread([this, i]() {
+				thread_pool_worker_func(i);
 			}));
 		}
 	}
 
 	~thread_pool_t() {
-		for (int i = 0; i < workers.size(); i++) {
-			job_queue.push(nullptr);
-		}
-
 		std::unique_lock lock_guard{lock};
-		worker_terminated.wait(lock_guard, [&] () {
-			return workers_terminated == workers.size();
-		});
+		stop = true;
+		work_added.notify_all();
 		lock_guard.unlock();
 
 		for (auto& worker : workers) {
 			worker.join();
 		}
+
+		// pool must be destroyed by the thread that created it
+		if (master_pinned) {
+			pin_current_thread(master_prev_cpus);
+		}
 	}
 
-	void thread_pool_worker_func() {
+	// worker
+	void thread_pool_worker_func(int worker_id) {
+		current_pool = this;
+		current_worker = worker_id;
+		if (worker_id < (int)worker_cpus.size()) {
+			pin_current_thread({worker_cpus[worker_id]});
+		}
+		rand_state = 0x9e3779b9u * (worker_id + 1);
+
 		while (true) {
-			if (job_if_t* job = job_queue.pop()) {
-				job->execute();
-				job->set_ready();
-			} else {
+			if (job_if_t* job = find_job(worker_id)) {
+				run(job);
+				continue;
+			}
+			if (!idle()) {
 				break;
 			}
 		}
+	}
+
+	// worker, spin then park, returns false if pool is terminating
+	bool idle() {
+		for (int i = 0; i < idle_spins; i++) {
+			if (pending.load(std::memory_order_relaxed) > 0) {
+				return true;
+			}
+			_mm_pause();
+		}
 
 		std::unique_lock lock_guard{lock};
-		workers_terminated++;
-		worker_terminated.notify_one();
+		sleepers.fetch_add(1, std::memory_order_seq_cst);
+		work_added.wait(lock_guard, [&] () {
+			return pending.load(std::memory_order_seq_cst) > 0 || stop;
+		});
+		sleepers.fetch_sub(1, std::memory_order_relaxed);
+		return pending.load(std::memory_order_relaxed) > 0 || !stop;
+	}
+
+	// job pushed into a group signals the group instead of itself
+	void push_job(job_if_t* job, job_group_t* group = nullptr) {
+		push_jobs(std::span<job_if_t* const>{&job, 1}, group);
+	}
+
+	// one enqueue & one wake for the whole batch
+	void push_jobs(std::span<job_if_t* const> jobs, job_group_t* group = nullptr) {
+		if (jobs.empty()) {
+			return;
+		}
+		if (group) {
+			group->pool = this;
+			group->add(jobs.size());
+		}
+		for (job_if_t* job : jobs) {
+			job->pool = this;
+			job->group = group;
+		}
+
+		if (current_pool == this) {
+			deques[current_worker].push_bulk(jobs);
+		} else {
+			const int injected_count = injected.push_bulk(jobs.data(), jobs.size());
+			for (size_t i = injected_count; i < jobs.size(); i++) {
+				const int worker_id = next_worker.fetch_add(1, std::memory_order_relaxed) % worker_count();
+				deques[worker_id].push(jobs[i]);
+			}
+		}
+		pending.fetch_add(jobs.size(), std::memory_order_seq_cst);
+		wake(jobs.size());
 	}
 
-	void push_job(job_if_t* job) {
-		job_queue.push(job);
+	// parked worker either sees pending under the lock or is already waiting
+	void wake(int count) {
+		const int parked = sleepers.load(std::memory_order_seq_cst);
+		if (parked == 0) {
+			return;
+		}
+		{ std::unique_lock lock_guard{lock}; }
+		if (count >= parked) {
+			work_added.notify_all();
+		} else {
+			for (int i = 0; i < count; i++) {
+				work_added.notify_one();
+			}
+		}
+	}
+
+	// own deque first, then shared ring, then steal starting from random victim
+	// worker_id - -1 if calling thread is not a worker of this pool
+	job_if_t* find_job(int worker_id) {
+		if (worker_id >= 0) {
+			if (job_if_t* job = deques[worker_id].pop()) {
+				pending.fetch_sub(1, std::memory_order_relaxed);
+				return job;
+			}
+		}
+		if (pending.load(std::memory_order_relaxed) <= 0) {
+			return nullptr;
+		}
+		if (job_if_t* job{}; injected.pop(job)) {
+			pending.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+
+		const int count = worker_count();
+		const int start = next_rand() % count;
+		for (int i = 0; i < count; i++) {
+			const int victim = (start + i) % count;
+			if (victim == worker_id) {
+				continue;
+			}
+			if (job_if_t* job = deques[victim].steal()) {
+				pending.fetch_sub(1, std::memory_order_relaxed);
+				return job;
+			}
+		}
+		return nullptr;
+	}
+
+	void run(job_if_t* job) {
+		job_group_t* group = job->group;
+		job->execute();
+		if (group) {
+			group->done();
+		} else {
+			job->set_ready();
+		}
+	}
+
+	// execute queued jobs until done() returns true or nothing is left to steal for a while
+	template<class done_t>
+	void help_until(const done_t& done) {
+		const int worker_id = current_pool == this ? current_worker : -1;
+		int spins = 0;
+		while (!done() && spins < idle_spins) {
+			if (job_if_t* job = find_job(worker_id)) {
+				run(job);
+				spins = 0;
+			} else {
+				_mm_pause();
+				spins++;
+			}
+		}
 	}
 
 	int worker_count() const {
 		return workers.size();
 	}
 
+	const thread_pool_settings_t& get_settings() const {
+		return settings;
+	}
+
+	const cpu_topology_t& get_topology() const {
+		return topology;
+	}
+
+	// cpu every worker is pinned to, empty if workers are not pinned
+	const std::vector<int>& get_worker_cpus() const {
+		return worker_cpus;
+	}
+
+	// parallel loops
+	// [start, stop) is split into chunks of grain items (grain <= 0 - picked automatically),
+	// chunks are claimed dynamically by pushed jobs and by the calling thread which returns when all chunks are done
+	// chunk boundaries depend only on range & grain so per chunk results are combined in deterministic order
+	// only as parallel as the workers that are free: jobs parked on a barrier (resident jobs) don't pick up chunks
+	static constexpr int chunks_per_thread = 4;
+	static constexpr int min_auto_grain = 256;
+
+	int compute_grain(int count, int grain) const {
+		if (grain > 0) {
+			return grain;
+		}
+		const int threads = worker_count() + 1;
+		return std::max(min_auto_grain, (count + threads * chunks_per_thread - 1) / (threads * chunks_per_thread));
+	}
+
+	// func(chunk) for every chunk in [0, chunk_count)
+	template<class func_t>
+	void run_chunks(int chunk_count, const func_t& func) {
+		std::atomic<int> next_chunk{};
+		auto run = [&] () {
+			for (int chunk = next_chunk.fetch_add(1, std::memory_order_relaxed); chunk < chunk_count; chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) {
+				func(chunk);
+			}
+		};
+
+		const int job_count = std::min(worker_count(), chunk_count - 1);
+		if (job_count <= 0) {
+			run();
+			return;
+		}
+
+		job_group_t group;
+		auto jobs = std::make_unique<ref_job_t<decltype(run)>[]>(job_count);
+		auto job_ptrs = std::make_unique<job_if_t*[]>(job_count);
+		for (int i = 0; i < job_count; i++) {
+			jobs[i].func = &run;
+			job_ptrs[i] = &jobs[i];
+		}
+		push_jobs(std::span<job_if_t* const>{job_ptrs.get(), (size_t)job_count}, &group);
+		run();
+		group.wait();
+	}
+
+	// func(range_start, range_stop)
+	template<class func_t>
+	void parallel_for(int start, int stop, int grain, const func_t& func) {
+		if (start >= stop) {
+			return;
+		}
+		grain = compute_grain(stop - start, grain);
+		run_chunks((stop - start + grain - 1) / grain, [&] (int chunk) {
+			const int chunk_start = start + chunk * grain;
+			func(chunk_start, std::min(chunk_start + grain, stop));
+		});
+	}
+
+	// func(range_start, range_stop) -> value_t, reduce(value_t, value_t) -> value_t, chunk results are reduced left to right
+	template<class value_t, class func_t, class reduce_t>
+	value_t parallel_reduce(int start, int stop, int grain, value_t init, const func_t& func, const reduce_t& reduce) {
+		if (start >= stop) {
+			return init;
+		}
+		grain = compute_grain(stop - start, grain);
+		const int chunk_count = (stop - start + grain - 1) / grain;
+
+		auto partial = std::make_unique<value_t[]>(chunk_count);
+		run_chunks(chunk_count, [&] (int chunk) {
+			const int chunk_start = start + chunk * grain;
+			partial[chunk] = func(chunk_start, std::min(chunk_start + grain, stop));
+		});
+
+		value_t result = init;
+		for (int chunk = 0; chunk < chunk_count; chunk++) {
+			result = reduce(result, partial[chunk]);
+		}
+		return result;
+	}
+
+	// value(i) -> value_t, out(i, prefix) gets init + sum of value(j) for j in [start, i)
+	// two passes: chunk sums, then every chunk is rescanned from its offset, returns init + total sum
+	template<class value_t, class value_func_t, class out_func_t>
+	value_t parallel_exclusive_scan(int start, int stop, int grain, value_t init, const value_func_t& value, const out_func_t& out) {
+		if (start >= stop) {
+			return init;
+		}
+		grain = compute_grain(stop - start, grain);
+		const int chunk_count = (stop - start + grain - 1) / grain;
+
+		auto offsets = std::make_unique<value_t[]>(chunk_count);
+		run_chunks(chunk_count, [&] (int chunk) {
+			const int chunk_start = start + chunk * grain;
+			const int chunk_stop = std::min(chunk_start + grain, stop);
+			value_t sum{};
+			for (int i = chunk_start; i < chunk_stop; i++) {
+				sum = sum + value(i);
+			}
+			offsets[chunk] = sum;
+		});
+
+		value_t total = init;
+		for (int chunk = 0; chunk < chunk_count; chunk++) {
+			value_t sum = offsets[chunk];
+			offsets[chunk] = total;
+			total = total + sum;
+		}
+
+		run_chunks(chunk_count, [&] (int chunk) {
+			const int chunk_start = start + chunk * grain;
+			const int chunk_stop = std::min(chunk_start + grain, stop);
+			value_t prefix = offsets[chunk];
+			for (int i = chunk_start; i < chunk_stop; i++) {
+				out(i, prefix);
+				prefix = prefix + value(i);
+			}
+		});
+		return total;
+	}
+
+	static uint32_t next_rand() {
+		rand_state ^= rand_state << 13;
+		rand_state ^= rand_state >> 17;
+		rand_state ^= rand_state << 5;
+		return rand_state;
+	}
+
+	static inline thread_local thread_pool_t* current_pool{};
+	static inline thread_local int current_worker{-1};
+	static inline thread_local uint32_t rand_state{0x2545f491u};
+
+	thread_pool_settings_t settings{};
+	cpu_topology_t topology{};
+	std::vector<int> worker_cpus;
+	std::vector<int> master_prev_cpus; // affinity of the creating thread before it was pinned
+	bool master_pinned{};
+
 	std::vector<std::thread> workers;
-	mt_queue_t<job_if_t*> job_queue;
+	std::unique_ptr<work_deque_t[]> deques;
+	mpmc_ring_t<job_if_t*> injected{injected_capacity_log2};
+	std::atomic<uint32_t> next_worker{};
+	std::atomic<int> pending{}; // jobs sitting in deques
+	std::atomic<int> sleepers{};
 
 	std::mutex lock;
-	std::condition_variable worker_terminated;
-	int workers_terminated{};
-};
\ No newline at end of file
+	std::condition_variable work_added;
+	bool stop{};
+};
+
+inline void job_if_t::wait() {
+	if (pool) {
+		pool->help_until([&] () {
+			return ready_status.load(std::memory_order_acquire);
+		});
+	}
+
+	std::unique_lock lock_guard{lock};
+	ready.wait(lock_guard, [&] (){
+		return ready_status.load(std::memory_order_acquire);
+	});
+	ready_status.store(false, std::memory_order_relaxed);
+}
+
+inline void job_group_t::wait() {
+	if (pool) {
+		pool->help_until([&] () {
+			return finished();
+		});
+	}
+
+	for (int i = 0; i < spin_count && !finished(); i++) {
+		_mm_pause();
+	}
+
+	uint32_t value = pending.fetch_or(parked_bit, std::memory_order_acq_rel);
+	if (value & count_mask) {
+		// last job will see the parked bit: wait for zero count, then for the job to leave done()
+		value |= parked_bit;
+		while (value & count_mask) {
+			pending.wait(value, std::memory_order_acquire);
+			value = pending.load(std::memory_order_acquire);
+		}
+		while (!released.load(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+		released.store(false, std::memory_order_relaxed);
+	}
+	pending.store(0, std::memory_order_relaxed);
+}
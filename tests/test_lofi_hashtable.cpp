@@ -1,10 +1,13 @@
 #include <chrono>
 #include <string>
 #include <fstream>
+#include <iostream>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 
 #include <lofi.hpp>
+#include <lofi_map.hpp>
 #include <utils.hpp>
 #include <sparse_cell.hpp>
 #include <thread_pool.hpp>
@@ -36,9 +39,20 @@ struct lofi_test_settings_t {
 	bool should_shuffle{};
 
 	bool should_check_hashtable{};
+
+	bool partitioned_build{};
+
+	// thread pool of job_count workers
+	bool pin_workers{};
+	bool reserve_master_core{};
  };
 
+// dim - dimension of generated cells, 2D cells ignore z settings
+template<class hashtable_t, int dim = 3>
 struct lofi_test_ctx_t {
+	using bucket_t = typename hashtable_t::bucket_t;
+	using cell_t = basic_sparse_cell_t<dim>;
+
 	struct job_t : public job_if_t {
 		job_t(lofi_test_ctx_t* _ctx, int _job_id)
 			: ctx{_ctx}
@@ -55,6 +69,11 @@ struct lofi_test_ctx_t {
 			max_lookup_scans = 0;
 			total_lookup_scans = 0;
 			all_lookups_passed = true;
+			max_batched_lookup_scans = 0;
+			total_batched_lookup_scans = 0;
+			all_batched_lookups_passed = true;
+			max_miss_lookup_scans = 0;
+			total_miss_lookup_scans = 0;
 		}
 
 		lofi_test_ctx_t* ctx{};
@@ -64,11 +83,20 @@ struct lofi_test_ctx_t {
 		int max_lookup_scans{};
 		int total_lookup_scans{};
 		bool all_lookups_passed{};
+		int max_batched_lookup_scans{};
+		int total_batched_lookup_scans{};
+		bool all_batched_lookups_passed{};
+		int max_miss_lookup_scans{};
+		int total_miss_lookup_scans{};
 	};
 
 	enum process_stage_t {
 		BuildHashtable,
+		BinHashtable,
+		BuildPartitionedHashtable,
 		DoLookups,
+		DoBatchedLookups,
+		DoMissLookups,
 	};
 
 	struct hash_ops_t {
@@ -76,7 +104,7 @@ struct lofi_test_ctx_t {
 			return sparse_cell_hasher_t{}(ctx->cells[cell_id]);
 		}
 
-		uint32_t hash(const sparse_cell_t& cell) const {
+		uint32_t hash(const cell_t& cell) const {
 			return sparse_cell_hasher_t{}(cell);
 		}
 
@@ -84,10 +112,14 @@ struct lofi_test_ctx_t {
 			return ctx->cells[cell_id1] == ctx->cells[cell_id2];
 		}
 
-		bool equals(uint32_t cell_id, const sparse_cell_t& cell) const {
+		bool equals(uint32_t cell_id, const cell_t& cell) const {
 			return ctx->cells[cell_id] == cell;
 		}
 
+		void prefetch(uint32_t cell_id) const {
+			lofi_prefetch(&ctx->cells[cell_id]);
+		}
+
 		lofi_test_ctx_t* ctx{};
 	};
 
@@ -97,21 +129,29 @@ struct lofi_test_ctx_t {
 		, job_count{settings.job_count}
 		, total_cell_count{cell_count * repeat}
 		, total_bucket_count{nextpow2(total_cell_count) * 2}
-		, thread_pool{job_count}
-		, should_check_hashtable{settings.should_check_hashtable} {
-		assert(total_cell_count <= lofi_max_buckets / 2);
+		, should_check_hashtable{settings.should_check_hashtable}
+		, partitioned_build{settings.partitioned_build}
+		, thread_pool{thread_pool_settings_t{
+			.thread_count = job_count,
+			.pin_workers = settings.pin_workers,
+			.reserve_master_core = settings.reserve_master_core
+		}} {
+		assert(total_cell_count <= hashtable_t::max_buckets / 2);
 
 		int_gen_t x_gen(settings.x_seed, settings.x_min, settings.x_max);
 		int_gen_t y_gen(settings.y_seed, settings.y_min, settings.y_max);
 		int_gen_t z_gen(settings.z_seed, settings.z_min, settings.z_max);
 
-		cells = std::make_unique<sparse_cell_t[]>(total_cell_count);
+		cells = std::make_unique<cell_t[]>(total_cell_count);
 		for (int i = 0; i < cell_count; i++) {
-			int x = x_gen.gen();
-			int y = y_gen.gen();
-			int z = z_gen.gen();
+			cell_t cell{};
+			cell[0] = x_gen.gen();
+			cell[1] = y_gen.gen();
+			if constexpr (dim == 3) {
+				cell[2] = z_gen.gen();
+			}
 			for (int k = 0; k < repeat; k++) {
-				cells[k * cell_count + i] = sparse_cell_t{x, y, z};
+				cells[k * cell_count + i] = cell;
 			}
 		}
 
@@ -123,12 +163,28 @@ struct lofi_test_ctx_t {
 
 		used_buckets_buffer = std::make_unique<uint32_t[]>(total_cell_count);
 
-		bucket_buffer = std::make_unique<lofi_bucket_t[]>(total_bucket_count);
-		std::memset(bucket_buffer.get(), 0x00, sizeof(lofi_bucket_t) * total_bucket_count);
+		if (partitioned_build) {
+			// several partitions per job so clustered inputs are spread more evenly
+			partition_log2 = std::min<uint32_t>(std::countr_zero((uint32_t)nextpow2(job_count)) + 2, lofi_partition_bins_t::max_partition_log2);
+			partition_log2 = std::min<uint32_t>(partition_log2, std::countr_zero((uint32_t)total_bucket_count));
+
+			binned_cells = std::make_unique<uint32_t[]>(total_cell_count);
+			bin_offsets = std::make_unique<uint32_t[]>(lofi_partition_bins_t::offsets_size(job_count, partition_log2));
+			overflow_cells_buffer = std::make_unique<uint32_t[]>(total_cell_count);
+		}
+
+		bucket_buffer = std::make_unique<bucket_t[]>(total_bucket_count);
+		std::memset(bucket_buffer.get(), 0x00, sizeof(bucket_t) * total_bucket_count);
+
+		if constexpr (hashtable_t::has_probe_bounds) {
+			probe_bounds = std::make_unique<lofi_probe_bound_t[]>(total_bucket_count);
+			std::memset(probe_bounds.get(), 0x00, sizeof(lofi_probe_bound_t) * total_bucket_count);
+		}
 
 		jobs.reserve(job_count);
 		for (int i = 0; i < job_count; i++) {
 			jobs.push_back(std::make_unique<job_t>(this, i));
+			job_ptrs.push_back(jobs.back().get());
 		}
 	}
 
@@ -143,8 +199,21 @@ struct lofi_test_ctx_t {
 			return std::chrono::duration_cast<microseconds_t>(time_point).count();
 		};
 
+		auto clear_buckets = [&] () {
+			std::memset(bucket_buffer.get(), 0x00, total_bucket_count * sizeof(bucket_t));
+			if constexpr (hashtable_t::has_probe_bounds) {
+				std::memset(probe_bounds.get(), 0x00, total_bucket_count * sizeof(lofi_probe_bound_t));
+			}
+		};
+
 		auto reset_t0 = now();
-		std::memset(bucket_buffer.get(), 0x00, total_bucket_count * sizeof(lofi_bucket_t));
+		if constexpr (hashtable_t::has_generations) {
+			if (!hashtable.advance_generation()) {
+				clear_buckets();
+			}
+		} else {
+			clear_buckets();
+		}
 		auto reset_t1 = now();
 		auto reset_dt = to_microsecs(reset_t1 - reset_t0);
 
@@ -152,17 +221,34 @@ struct lofi_test_ctx_t {
 			job->reset_track_state();
 		}
 
-		hashtable.reset(bucket_buffer.get(), total_bucket_count, next_cell.get(), total_cell_count);
+		hashtable.reset(bucket_buffer.get(), total_bucket_count, next_cell.get(), total_cell_count, probe_bounds.get());
 		used_buckets.reset(used_buckets_buffer.get(), total_cell_count);
 
 		auto t1 = now();
-		dispatch_jobs(BuildHashtable);
+		if (partitioned_build) {
+			bins.reset(binned_cells.get(), bin_offsets.get(), job_count, partition_log2);
+			overflow_cells.reset(overflow_cells_buffer.get(), total_cell_count);
+
+			dispatch_jobs(BinHashtable);
+			dispatch_jobs(BuildPartitionedHashtable);
+			put_overflow_cells();
+		} else {
+			dispatch_jobs(BuildHashtable);
+		}
 		auto t2 = now();
 		dispatch_jobs(DoLookups);
 		auto t3 = now();
+		dispatch_jobs(DoBatchedLookups);
+		auto t4 = now();
+		dispatch_jobs(DoMissLookups);
+		auto t5 = now();
 
 		auto dt21 = to_microsecs(t2 - t1);
+		last_build_time = dt21;
 		auto dt32 = to_microsecs(t3 - t2);
+		auto dt43 = to_microsecs(t4 - t3);
+		last_lookup_time = dt32 + dt43;
+		auto dt54 = to_microsecs(t5 - t4);
 		
 		int total_buckets = used_buckets.allocated();
 		int max_count = 0;
@@ -178,16 +264,28 @@ struct lofi_test_ctx_t {
 		int max_lookup_scans = 0;
 		int total_lookup_scans = 0;
 		bool all_lookups_passed = true;
+		int max_batched_lookup_scans = 0;
+		int total_batched_lookup_scans = 0;
+		bool all_batched_lookups_passed = true;
+		int max_miss_lookup_scans = 0;
+		int total_miss_lookup_scans = 0;
 		for (auto& job : jobs) {
 			max_insertion_scans = std::max(max_insertion_scans, job->max_insertion_scans);
 			total_insertion_scans += job->total_insertion_scans;
 			max_lookup_scans = std::max(max_lookup_scans, job->max_lookup_scans);
 			total_lookup_scans += job->total_lookup_scans;
 			all_lookups_passed &= job->all_lookups_passed;
+			max_batched_lookup_scans = std::max(max_batched_lookup_scans, job->max_batched_lookup_scans);
+			total_batched_lookup_scans += job->total_batched_lookup_scans;
+			all_batched_lookups_passed &= job->all_batched_lookups_passed;
+			max_miss_lookup_scans = std::max(max_miss_lookup_scans, job->max_miss_lookup_scans);
+			total_miss_lookup_scans += job->total_miss_lookup_scans;
 		}
 
 		double avg_insertion_scans = (double)total_insertion_scans / total_cell_count;
 		double avg_lookup_scans = (double)total_lookup_scans / total_cell_count;
+		double avg_batched_lookup_scans = (double)total_batched_lookup_scans / total_cell_count;
+		double avg_miss_lookup_scans = (double)total_miss_lookup_scans / total_cell_count;
 
 		const char* check_status = "unchecked";
 		if (should_check_hashtable) {
@@ -198,6 +296,8 @@ struct lofi_test_ctx_t {
 			{"lofi_reset", reset_dt},
 			{"lofi_build", dt21},
 			{"lofi_lookup", dt32},
+			{"lofi_batched_lookup", dt43},
+			{"lofi_miss_lookup", dt54},
 
 			{"max_insertion_scans", max_insertion_scans},
 			{"total_insertion_scans", total_insertion_scans},
@@ -208,6 +308,17 @@ struct lofi_test_ctx_t {
 			{"avg_lookup_scans", avg_lookup_scans},
 			{"all_lookups_passed", all_lookups_passed},
 
+			{"max_batched_lookup_scans", max_batched_lookup_scans},
+			{"total_batched_lookup_scans", total_batched_lookup_scans},
+			{"avg_batched_lookup_scans", avg_batched_lookup_scans},
+			{"all_batched_lookups_passed", all_batched_lookups_passed},
+
+			{"max_miss_lookup_scans", max_miss_lookup_scans},
+			{"total_miss_lookup_scans", total_miss_lookup_scans},
+			{"avg_miss_lookup_scans", avg_miss_lookup_scans},
+
+			{"overflow_cells", partitioned_build ? overflow_cells.allocated() : 0},
+
 			{"max_count_in_bucket", max_count},
 			{"used_buckets", total_buckets},
 			{"hashtable_check", check_status},
@@ -224,7 +335,7 @@ struct lofi_test_ctx_t {
 		int total_buckets = used_buckets.allocated();
 		auto used_buckets_view = used_buckets.view_allocated();
 		for (int i = 0; i < total_buckets; i++) {
-			lofi_bucket_t bucket = hashtable.get_bucket(used_buckets_view[i]);
+			bucket_t bucket = hashtable.get_bucket(used_buckets_view[i]);
 	
 			if (!bucket.used()) {
 				return false;
@@ -256,10 +367,30 @@ struct lofi_test_ctx_t {
 				break;
 			}
 
+			case BinHashtable: {
+				bin_hashtable(job);
+				break;
+			}
+
+			case BuildPartitionedHashtable: {
+				build_partitioned_hashtable(job);
+				break;
+			}
+
 			case DoLookups: {
 				do_lookups(job);
 				break;
 			}
+
+			case DoBatchedLookups: {
+				do_batched_lookups(job);
+				break;
+			}
+
+			case DoMissLookups: {
+				do_miss_lookups(job);
+				break;
+			}
 		}
 	}
 
@@ -310,7 +441,7 @@ struct lofi_test_ctx_t {
 
 		auto [start, stop] = compute_job_range(total_cell_count, jobs.size(), job->job_id);
 		for (int item = start; item < stop; item++) {
-			lofi_insertion_t insertion = hashtable.put(item, hash_ops_t{this});
+			auto insertion = hashtable.put(item, hash_ops_t{this});
 			assert(insertion.inserted());
 
 			int scans = insertion.scans() + 1;
@@ -331,10 +462,85 @@ struct lofi_test_ctx_t {
 		}
 	}
 
+	void bin_hashtable(job_t* job) {
+		auto [start, stop] = compute_job_range(total_cell_count, jobs.size(), job->job_id);
+		bins.bin(job->job_id, start, stop, [&] (uint32_t item) {
+			return hashtable.get_partition(hash_ops_t{this}.hash(item), partition_log2);
+		});
+	}
+
+	// each partition has a single owner so insertion doesn't contend on shared buckets
+	void build_partitioned_hashtable(job_t* job) {
+		bucket_batch_t batch{};
+		bucket_batch_t overflow{};
+
+		auto flush_batch = [&] (lofi_stack_alloc_t<uint32_t>& alloc, bucket_batch_t& batch) {
+			auto view = alloc.allocate(batch.count());
+			assert(view.valid());
+			std::memcpy(view.data(), batch.data(), batch.byte_size());
+			batch.reset();
+		};
+
+		for (uint32_t partition = job->job_id; partition < bins.partition_count(); partition += jobs.size()) {
+			for (int binning_job = 0; binning_job < jobs.size(); binning_job++) {
+				auto items = bins.view(binning_job, partition);
+				for (int i = 0; i < items.size(); i++) {
+					uint32_t item = items[i];
+
+					auto insertion = hashtable.put_partitioned(item, partition_log2, hash_ops_t{this});
+					if (!insertion.inserted()) {
+						if (!overflow.push(item)) {
+							flush_batch(overflow_cells, overflow);
+							overflow.push(item); // guaranteed to succeed
+						}
+						continue;
+					}
+
+					int scans = insertion.scans() + 1;
+					job->max_insertion_scans = std::max(job->max_insertion_scans, scans);
+					job->total_insertion_scans += scans;
+
+					if (insertion.new_bucket()) {
+						uint32_t bucket = insertion.bucket();
+						if (!batch.push(bucket)) {
+							flush_batch(used_buckets, batch);
+							batch.push(bucket); // guaranteed to succeed
+						}
+					}
+				}
+			}
+		}
+		if (!batch.empty()) {
+			flush_batch(used_buckets, batch);
+		}
+		if (!overflow.empty()) {
+			flush_batch(overflow_cells, overflow);
+		}
+	}
+
+	// master, items that didn't fit into their partition
+	void put_overflow_cells() {
+		auto overflow_view = overflow_cells.view_allocated();
+		for (int i = 0; i < overflow_view.size(); i++) {
+			auto insertion = hashtable.put(overflow_view[i], hash_ops_t{this});
+			assert(insertion.inserted());
+
+			int scans = insertion.scans() + 1;
+			jobs[0]->max_insertion_scans = std::max(jobs[0]->max_insertion_scans, scans);
+			jobs[0]->total_insertion_scans += scans;
+
+			if (insertion.new_bucket()) {
+				auto view = used_buckets.allocate(1);
+				assert(view.valid());
+				view[0] = insertion.bucket();
+			}
+		}
+	}
+
 	void do_lookups(job_t* job) {
 		auto [start, stop] = compute_job_range(total_cell_count, job_count, job->job_id);
 		for (int i = start; i < stop; i++) {
-			lofi_search_result_t result = hashtable.get(cells[i], hash_ops_t{this});
+			auto result = hashtable.get(cells[i], hash_ops_t{this});
 			if (!result.valid()) {
 				job->all_lookups_passed = false;
 				return;
@@ -345,16 +551,53 @@ struct lofi_test_ctx_t {
 		}
 	}
 
-	void dispatch_jobs(process_stage_t _stage) {
-		stage = _stage;
-		for (auto& job : jobs) {
-			thread_pool.push_job(job.get());
+	static constexpr int lookup_batch_size = 64;
+
+	void do_batched_lookups(job_t* job) {
+		using search_result_t = typename hashtable_t::search_result_t;
+
+		search_result_t results[lookup_batch_size];
+
+		auto [start, stop] = compute_job_range(total_cell_count, job_count, job->job_id);
+		for (int i = start; i < stop; i += lookup_batch_size) {
+			int batch_size = std::min(lookup_batch_size, stop - i);
+			hashtable.get_many(&cells[i], batch_size, results, hash_ops_t{this});
+			for (int k = 0; k < batch_size; k++) {
+				if (!results[k].valid()) {
+					job->all_batched_lookups_passed = false;
+					return;
+				}
+				int scans = results[k].scans + 1;
+				job->max_batched_lookup_scans = std::max(job->max_batched_lookup_scans, scans);
+				job->total_batched_lookup_scans += scans;
+			}
 		}
-		for (auto& job : jobs) {
-			job->wait();
+	}
+
+	// cells are shifted out of the generated range so every lookup is a miss (neighbour lookups are mostly misses)
+	void do_miss_lookups(job_t* job) {
+		cell_t miss_offset{};
+		miss_offset[dim - 1] = 1 << 20;
+
+		auto [start, stop] = compute_job_range(total_cell_count, job_count, job->job_id);
+		for (int i = start; i < stop; i++) {
+			auto result = hashtable.get(cells[i] + miss_offset, hash_ops_t{this});
+			assert(!result.valid());
+
+			int scans = result.scans;
+			job->max_miss_lookup_scans = std::max(job->max_miss_lookup_scans, scans);
+			job->total_miss_lookup_scans += scans;
 		}
 	}
 
+	void dispatch_jobs(process_stage_t _stage) {
+		stage = _stage;
+
+		job_group_t group;
+		thread_pool.push_jobs(job_ptrs, &group);
+		group.wait();
+	}
+
 	int cell_count{};
 	int repeat{};
 	int job_count{};
@@ -363,27 +606,134 @@ struct lofi_test_ctx_t {
 
 	bool should_test_std{};
 	bool should_check_hashtable{};
+	bool partitioned_build{};
 
-	std::unique_ptr<sparse_cell_t[]> cells{};
+	std::unique_ptr<cell_t[]> cells{};
 	std::unique_ptr<uint32_t[]> next_cell{};
-	std::unique_ptr<lofi_bucket_t[]> bucket_buffer{};
+	std::unique_ptr<bucket_t[]> bucket_buffer{};
+	std::unique_ptr<lofi_probe_bound_t[]> probe_bounds{};
 	std::unique_ptr<uint32_t[]> used_buckets_buffer{};
 
-	lofi_hashtable_t hashtable{};
+	hashtable_t hashtable{};
 	lofi_stack_alloc_t<uint32_t> used_buckets{};
 
+	double last_build_time{};
+	double last_lookup_time{};
+
+	uint32_t partition_log2{};
+	std::unique_ptr<uint32_t[]> binned_cells{};
+	std::unique_ptr<uint32_t[]> bin_offsets{};
+	std::unique_ptr<uint32_t[]> overflow_cells_buffer{};
+	lofi_partition_bins_t bins{};
+	lofi_stack_alloc_t<uint32_t> overflow_cells{};
+
 	thread_pool_t thread_pool;
 	std::vector<std::unique_ptr<job_t>> jobs;
+	std::vector<job_if_t*> job_ptrs;
 	process_stage_t stage{};
 };
 
-inline constexpr const int test_invocations = 128;
+inline constexpr const int test_invocations = 300; // generation layout wraps around once in 255 invocations
+
+// returns average build time
+template<class hashtable_t, int dim = 3>
+double test_lofi_hashtable(const std::string& test_name, const lofi_test_settings_t& settings, const json& basic_stats) {
+	using layout_t = typename hashtable_t::layout_t;
+
+	const char* build = settings.partitioned_build ? "partitioned" : "cas";
+
+	json stats = basic_stats;
+	stats["layout"] = layout_t::name;
+	stats["probing"] = hashtable_t::probing_t::name;
+	stats["bucket_size"] = sizeof(typename hashtable_t::bucket_t);
+	stats["build"] = build;
+	stats["dim"] = dim;
+
+	double total_build_time = 0.0;
+
+	lofi_test_ctx_t<hashtable_t, dim> ctx{settings};
+	for (int i = 0; i < test_invocations; i++) {
+		stats["stats"].push_back(ctx.update());
+		total_build_time += ctx.last_build_time;
+	}
+
+	std::string suffix = std::string{"_"} + layout_t::name;
+	if (hashtable_t::has_probe_bounds) {
+		suffix += std::string{"_"} + hashtable_t::probing_t::name;
+	}
+	if (settings.partitioned_build) {
+		suffix += "_partitioned";
+	}
+	if (dim == 2) {
+		suffix += "_2d";
+	}
+	std::ofstream ofs(test_name + suffix + ".json");
+	ofs << std::setw(4) << stats;
+
+	return total_build_time / test_invocations;
+}
+
+json make_basic_stats(const lofi_test_settings_t& settings) {
+	return json::object({
+		{"cell_count", settings.cell_count},
+		{"repeat", settings.repeat},
+		{"total_cells", settings.cell_count * settings.repeat}, // not neccessary but human readable
+		{"job_count", settings.job_count},
+		{"x_seed_min_max", {settings.x_seed, settings.x_min, settings.x_max}},
+		{"y_seed_min_max", {settings.y_seed, settings.y_min, settings.y_max}},
+		{"z_seed_min_max", {settings.z_seed, settings.z_min, settings.z_max}},
+		{"shuffle_seed", settings.shuffle_seed},
+		{"should_shuffle", settings.should_shuffle},
+		{"stats", json::array()},
+	});
+}
+
+// same total amount of cells: uniform - every cell is unique, clustered - few cells repeated many times (heavy contention)
+void test_lofi_partitioned_build() {
+	lofi_test_settings_t uniform_settings{
+		.cell_count = 1 << 18,
+		.repeat = 1,
+		.job_count = 24,
+
+		.x_seed = 41,
+		.x_min = -10000,
+		.x_max = +10000,
+
+		.y_seed = 42,
+		.y_min = -10000,
+		.y_max = +10000,
+
+		.z_seed = 43,
+		.z_min = -10000,
+		.z_max = +10000,
+
+		.shuffle_seed = 123,
+		.should_shuffle = true,
+
+		.should_check_hashtable = true
+	};
+
+	lofi_test_settings_t clustered_settings = uniform_settings;
+	clustered_settings.cell_count = 1 << 6;
+	clustered_settings.repeat = 1 << 12;
+
+	auto run_case = [&] (const std::string& test_name, lofi_test_settings_t settings) {
+		for (bool partitioned : {false, true}) {
+			settings.partitioned_build = partitioned;
+			double build_time = test_lofi_hashtable<lofi_generation_hashtable_t>(test_name, settings, make_basic_stats(settings));
+			std::cout << test_name << (partitioned ? " partitioned" : " cas") << " build: " << build_time << "us avg" << std::endl;
+		}
+	};
+
+	run_case("uniform_build_case", uniform_settings);
+	run_case("clustered_build_case", clustered_settings);
+}
 
 void test_lofi_hashtable() {
 	const std::string basic_test_name = "some_basic_case";
 
 	lofi_test_settings_t settings{
-		.cell_count = 1 << 14, // !!! total_cell_count <= 1 << 20, implementation limit !!!
+		.cell_count = 1 << 14, // !!! total_cell_count <= 1 << 19 for compact layout, implementation limit !!!
 		.repeat = 1 << 4,
 		.job_count = 24,
 
@@ -405,30 +755,193 @@ void test_lofi_hashtable() {
 		.should_check_hashtable = true
 	};
 
-	json basic_stats = json::object({
+	json basic_stats = make_basic_stats(settings);
+
+	test_lofi_hashtable<lofi_hashtable_t>(basic_test_name, settings, basic_stats);
+	test_lofi_hashtable<lofi_wide_hashtable_t>(basic_test_name, settings, basic_stats);
+	test_lofi_hashtable<lofi_generation_hashtable_t>(basic_test_name, settings, basic_stats);
+	test_lofi_hashtable<lofi_bounded_generation_hashtable_t>(basic_test_name, settings, basic_stats);
+}
+
+// same amount of distinct cells in 2D & 3D, 2D cells are smaller & cheaper to hash (planar scenes)
+void test_lofi_dimensions() {
+	lofi_test_settings_t settings{
+		.cell_count = 1 << 16,
+		.repeat = 1 << 2,
+		.job_count = 24,
+
+		.x_seed = 41,
+		.x_min = -10000,
+		.x_max = +10000,
+
+		.y_seed = 42,
+		.y_min = -10000,
+		.y_max = +10000,
+
+		.z_seed = 43,
+		.z_min = -10000,
+		.z_max = +10000,
+
+		.shuffle_seed = 123,
+		.should_shuffle = true,
+
+		.should_check_hashtable = true
+	};
+
+	json basic_stats = make_basic_stats(settings);
+
+	double build_time_3d = test_lofi_hashtable<lofi_bounded_generation_hashtable_t, 3>("dimension_case", settings, basic_stats);
+	double build_time_2d = test_lofi_hashtable<lofi_bounded_generation_hashtable_t, 2>("dimension_case", settings, basic_stats);
+	std::cout << "3d build: " << build_time_3d << "us avg" << std::endl;
+	std::cout << "2d build: " << build_time_2d << "us avg" << std::endl;
+}
+
+// grid build & neighbour lookups (hot phases of the physics update) with growing worker count,
+// workers are either free to migrate or pinned one per core with the master keeping its own core
+void test_lofi_scaling() {
+	constexpr int scaling_invocations = 50;
+
+	const cpu_topology_t topology = cpu_topology_t::detect();
+	const int default_workers = topology.default_worker_count(false, true);
+	std::cout << "cpu topology: " << topology.core_count() << " cores, " << topology.logical_count() << " threads, "
+		<< topology.node_count << " numa nodes, default worker count: " << default_workers << std::endl;
+
+	std::vector<int> worker_counts{default_workers, topology.core_count(), topology.logical_count()};
+	for (int count = 1; count < topology.logical_count(); count *= 2) {
+		worker_counts.push_back(count);
+	}
+	std::sort(worker_counts.begin(), worker_counts.end());
+	worker_counts.erase(std::unique(worker_counts.begin(), worker_counts.end()), worker_counts.end());
+
+	lofi_test_settings_t settings{
+		.cell_count = 1 << 18,
+		.repeat = 1,
+
+		.x_seed = 41,
+		.x_min = -10000,
+		.x_max = +10000,
+
+		.y_seed = 42,
+		.y_min = -10000,
+		.y_max = +10000,
+
+		.z_seed = 43,
+		.z_min = -10000,
+		.z_max = +10000,
+
+		.shuffle_seed = 123,
+		.should_shuffle = true,
+
+		.should_check_hashtable = false
+	};
+
+	json results = json::array();
+	double base_time = 0.0;
+	for (int worker_count : worker_counts) {
+		for (bool pinned : {false, true}) {
+			settings.job_count = worker_count;
+			settings.pin_workers = pinned;
+			settings.reserve_master_core = pinned;
+
+			double build_time = 0.0;
+			double lookup_time = 0.0;
+			lofi_test_ctx_t<lofi_generation_hashtable_t> ctx{settings};
+			for (int i = 0; i < scaling_invocations; i++) {
+				ctx.update();
+				build_time += ctx.last_build_time;
+				lookup_time += ctx.last_lookup_time;
+			}
+			build_time /= scaling_invocations;
+			lookup_time /= scaling_invocations;
+
+			const double total_time = build_time + lookup_time;
+			if (base_time == 0.0) {
+				base_time = total_time;
+			}
+			std::cout << "workers " << worker_count << (pinned ? " pinned" : " unpinned") << ": build " << build_time << "us, lookups "
+				<< lookup_time << "us, speedup " << base_time / total_time << std::endl;
+
+			results.push_back(json::object({
+				{"workers", worker_count},
+				{"pinned", pinned},
+				{"build", build_time},
+				{"lookups", lookup_time},
+				{"speedup", base_time / total_time},
+			}));
+		}
+	}
+
+	json stats = json::object({
+		{"cores", topology.core_count()},
+		{"threads", topology.logical_count()},
+		{"numa_nodes", topology.node_count},
+		{"default_workers", default_workers},
 		{"cell_count", settings.cell_count},
-		{"repeat", settings.repeat},
-		{"total_cells", settings.cell_count * settings.repeat}, // not neccessary but human readable
-		{"job_count", settings.job_count},
-		{"x_seed_min_max", {settings.x_seed, settings.x_min, settings.x_max}},
-		{"y_seed_min_max", {settings.y_seed, settings.y_min, settings.y_max}},
-		{"z_seed_min_max", {settings.z_seed, settings.z_min, settings.z_max}},
-		{"shuffle_seed", settings.shuffle_seed},
-		{"should_shuffle", settings.should_shuffle},
-		{"stats", json::array()},
+		{"stats", results},
 	});
+	std::ofstream ofs("scaling_case.json");
+	ofs << std::setw(4) << stats;
+}
 
-	json stats = basic_stats;
-	lofi_test_ctx_t ctx{settings};
-	for (int i = 0; i < test_invocations; i++) {
-		stats["stats"].push_back(ctx.update());
+// several rebuilds of different sizes: concurrent inserts, then every key is checked against std::unordered_map
+bool test_lofi_map() {
+	using map_t = lofi_map_t<sparse_cell_t, uint32_t, sparse_cell_hasher_t>;
+
+	const int job_count = 8;
+	const int rebuild_sizes[] = {1 << 16, 1 << 10, 1 << 14, 0, 1 << 16};
+
+	thread_pool_t thread_pool{job_count};
+
+	map_t map{};
+	bool passed = true;
+	for (int round = 0; round < std::size(rebuild_sizes); round++) {
+		const int item_count = rebuild_sizes[round];
+
+		int_gen_t gen(round, -32, +32); // small range so keys repeat
+		std::vector<sparse_cell_t> cells(item_count);
+		std::unordered_map<sparse_cell_t, uint32_t, sparse_cell_hasher_t> expected;
+		for (auto& cell : cells) {
+			cell = sparse_cell_t{gen.gen(), gen.gen(), gen.gen()};
+			expected[cell]++;
+		}
+
+		map.reset(item_count);
+
+		thread_pool.parallel_for(0, item_count, 0, [&] (int start, int stop) {
+			for (int i = start; i < stop; i++) {
+				map.insert(cells[i], i);
+			}
+		});
+
+		passed &= map.size() == item_count;
+		for (auto& [cell, count] : expected) {
+			uint32_t visited = 0;
+			map.for_each(cell, [&] (uint32_t i) {
+				passed &= cells[i] == cell;
+				visited++;
+			});
+			passed &= visited == count && map.count(cell) == count;
+		}
+		passed &= !map.contains(sparse_cell_t{1000, 1000, 1000});
+
+		uint32_t groups = 0;
+		map.for_each_group([&] (const sparse_cell_t&, lofi_flat_list_walker_t) {
+			groups++;
+		});
+		passed &= groups == expected.size();
 	}
 
-	std::ofstream ofs(basic_test_name + ".json");
-	ofs << std::setw(4) << stats;
+	std::cout << "lofi map: " << (passed ? "passed" : "failed") << std::endl;
+	return passed;
 }
 
 int main() {
 	test_lofi_hashtable();
+	test_lofi_partitioned_build();
+	test_lofi_dimensions();
+	test_lofi_scaling();
+	if (!test_lofi_map()) {
+		return 1;
+	}
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include <cmath>
+#include <random>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include <simd.hpp>
+
+// every test is a template over the vector flavour, instantiated for every level supported by the cpu
+// (must be force inlined into target entry points, same as kernels)
+#define SIMD_TEST_ENTRY_POINTS(name) \
+	YIN_YANG_TARGET_AVX2 bool name##_avx2() { return name<simd_avx2_t>(); } \
+	YIN_YANG_TARGET_AVX512 bool name##_avx512() { return name<simd_avx512_t>(); }
+
+inline constexpr int max_lanes = 16;
+
+template<class v_t>
+YIN_YANG_FORCE_INLINE bool test_masked_tail() {
+	bool valid = true;
+	for (int n = 0; n <= v_t::lanes; n++) {
+		alignas(64) float src[max_lanes];
+		alignas(64) float dst[max_lanes];
+		alignas(64) float loaded[max_lanes];
+		alignas(64) int32_t isrc[max_lanes];
+		alignas(64) int32_t idst[max_lanes];
+		for (int k = 0; k < max_lanes; k++) {
+			src[k] = (float)(k + 1);
+			dst[k] = -1.0f;
+			isrc[k] = k + 1;
+			idst[k] = -1;
+		}
+
+		const auto mask = v_t::tail_mask(n);
+		const typename v_t::f32 v = v_t::load(src, mask);
+		v_t::store(loaded, v);
+		v_t::store(dst, v_t::add(v, v_t::set1(1.0f)), mask);
+		v_t::store(idst, v_t::add(v_t::load(isrc, mask), v_t::set1((int32_t)1)), mask);
+
+		for (int k = 0; k < v_t::lanes; k++) {
+			valid &= loaded[k] == (k < n ? src[k] : 0.0f);
+			valid &= dst[k] == (k < n ? src[k] + 1.0f : -1.0f);
+			valid &= idst[k] == (k < n ? isrc[k] + 1 : -1);
+		}
+	}
+	return valid;
+}
+SIMD_TEST_ENTRY_POINTS(test_masked_tail)
+
+template<class v_t>
+YIN_YANG_FORCE_INLINE bool test_reductions() {
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+
+	bool valid = true;
+	for (int r = 0; r < 100; r++) {
+		alignas(64) float data[max_lanes];
+		for (int k = 0; k < v_t::lanes; k++) {
+			data[k] = dist(gen);
+		}
+
+		const typename v_t::f32 v = v_t::load(data);
+		float sum = 0.0f;
+		for (int k = 0; k < v_t::lanes; k++) {
+			sum += data[k];
+		}
+		valid &= std::abs(v_t::hsum(v) - sum) <= 1e-3f;
+		valid &= v_t::hmin(v) == *std::min_element(data, data + v_t::lanes);
+		valid &= v_t::hmax(v) == *std::max_element(data, data + v_t::lanes);
+	}
+	return valid;
+}
+SIMD_TEST_ENTRY_POINTS(test_reductions)
+
+template<class v_t>
+YIN_YANG_FORCE_INLINE bool test_rsqrt() {
+	bool valid = true;
+	float max_error = 0.0f;
+	for (float x = 1e-3f; x < 1e3f; x *= 1.01f) {
+		alignas(64) float result[max_lanes];
+		v_t::store(result, v_t::rsqrt(v_t::set1(x)));
+
+		const float expected = 1.0f / std::sqrt(x);
+		max_error = std::max(max_error, std::abs(result[0] - expected) / expected);
+	}
+	valid &= max_error < 5e-6f; // one Newton step on top of 12 bit estimate
+	return valid;
+}
+SIMD_TEST_ENTRY_POINTS(test_rsqrt)
+
+template<class v_t>
+YIN_YANG_FORCE_INLINE bool test_gather_scatter() {
+	float fdata[3 * max_lanes];
+	int32_t idata[3 * max_lanes];
+	for (int k = 0; k < 3 * max_lanes; k++) {
+		fdata[k] = (float)k * 0.5f;
+		idata[k] = k * 7;
+	}
+
+	bool valid = true;
+	const typename v_t::i32 index = v_t::lane_index(3);
+	for (int c = 0; c < 3; c++) {
+		alignas(64) float fresult[max_lanes];
+		alignas(64) int32_t iresult[max_lanes];
+		v_t::store(fresult, v_t::gather(fdata + c, index));
+		v_t::store(iresult, v_t::gather(idata + c, index));
+		for (int k = 0; k < v_t::lanes; k++) {
+			valid &= fresult[k] == fdata[3 * k + c];
+			valid &= iresult[k] == idata[3 * k + c];
+		}
+	}
+
+	int32_t scattered[3 * max_lanes] = {};
+	v_t::scatter(scattered + 1, index, v_t::gather(idata + 1, index));
+	for (int k = 0; k < 3 * v_t::lanes; k++) {
+		valid &= scattered[k] == (k % 3 == 1 ? idata[k] : 0);
+	}
+	return valid;
+}
+SIMD_TEST_ENTRY_POINTS(test_gather_scatter)
+
+// integer & conversion ops must match the scalar flavour lane by lane
+template<class v_t>
+YIN_YANG_FORCE_INLINE bool test_lane_ops() {
+	using s_t = simd_scalar_t;
+
+	std::mt19937 gen(43);
+	std::uniform_real_distribution<float> fdist(-1e6f, 1e6f);
+
+	bool valid = true;
+	for (int r = 0; r < 100; r++) {
+		alignas(64) int32_t a[max_lanes];
+		alignas(64) int32_t b[max_lanes];
+		alignas(64) float f[max_lanes];
+		for (int k = 0; k < v_t::lanes; k++) {
+			a[k] = (int32_t)gen();
+			b[k] = (int32_t)gen();
+			f[k] = fdist(gen);
+		}
+
+		const typename v_t::i32 va = v_t::load(a);
+		const typename v_t::i32 vb = v_t::load(b);
+		const typename v_t::f32 vf = v_t::load(f);
+
+		alignas(64) int32_t mul[max_lanes], rot[max_lanes], shifted[max_lanes], xored[max_lanes], converted[max_lanes];
+		alignas(64) float clamped[max_lanes], masked[max_lanes];
+		const int mask_count = v_t::mask_count(v_t::cmp_lt(vf, v_t::set1(0.0f)));
+		v_t::store(mul, v_t::add(v_t::mullo(va, vb), va));
+		v_t::store(rot, v_t::template rotl<13>(va));
+		v_t::store(shifted, v_t::bit_xor(v_t::template shl<5>(va), v_t::template shr<7>(vb)));
+		v_t::store(xored, v_t::bit_xor(va, vb));
+		v_t::store(converted, v_t::cvtt(v_t::floor(vf)));
+		v_t::store(clamped, v_t::max(v_t::set1(-1e5f), v_t::min(v_t::set1(1e5f), vf)));
+		v_t::store(masked, v_t::mask_zero(v_t::mask_and(v_t::cmp_ge(vf, v_t::set1(-5e5f)), v_t::cmp_lt(vf, v_t::set1(5e5f))), vf));
+
+		int expected_mask_count = 0;
+		for (int k = 0; k < v_t::lanes; k++) {
+			expected_mask_count += s_t::mask_count(s_t::cmp_lt(f[k], 0.0f));
+			valid &= mul[k] == s_t::add(s_t::mullo(a[k], b[k]), a[k]);
+			valid &= rot[k] == s_t::rotl<13>(a[k]);
+			valid &= shifted[k] == s_t::bit_xor(s_t::shl<5>(a[k]), s_t::shr<7>(b[k]));
+			valid &= xored[k] == s_t::bit_xor(a[k], b[k]);
+			valid &= converted[k] == s_t::cvtt(s_t::floor(f[k]));
+			valid &= clamped[k] == s_t::max(-1e5f, s_t::min(1e5f, f[k]));
+			valid &= masked[k] == s_t::mask_zero(s_t::mask_and(s_t::cmp_ge(f[k], -5e5f), s_t::cmp_lt(f[k], 5e5f)), f[k]);
+		}
+		valid &= mask_count == expected_mask_count;
+	}
+	return valid;
+}
+SIMD_TEST_ENTRY_POINTS(test_lane_ops)
+
+// simd_add dispatched on the current level, every length exercises a different tail
+bool test_add() {
+	bool valid = true;
+	for (int len = 0; len <= 40; len++) {
+		float a[48], b[48], expected[48];
+		for (int k = 0; k < 48; k++) {
+			a[k] = (float)k;
+			b[k] = (float)(2 * k + 1);
+			expected[k] = k < len ? a[k] + b[k] : a[k];
+		}
+		simd_add(a, b, len);
+		valid &= std::equal(a, a + 48, expected);
+	}
+	return valid;
+}
+
+template<class scalar_func_t, class avx2_func_t, class avx512_func_t>
+bool run_test(const char* name, scalar_func_t scalar_func, avx2_func_t avx2_func, avx512_func_t avx512_func) {
+	bool valid = true;
+	for (int level = 0; level <= (int)simd_cpu_level(); level++) {
+		// there is no sse4.2 vector flavour, kernels fall back to scalar which is already tested
+		if ((simd_level_t)level == simd_level_t::Sse42) {
+			continue;
+		}
+
+		bool result = true;
+		switch ((simd_level_t)level) {
+			case simd_level_t::Scalar:
+				result = scalar_func();
+				break;
+			case simd_level_t::Avx2:
+				result = avx2_func();
+				break;
+			case simd_level_t::Avx512:
+				result = avx512_func();
+				break;
+			default:
+				break;
+		}
+		std::cout << name << " " << simd_level_name((simd_level_t)level) << ": " << (result ? "valid" : "invalid") << "\n";
+		valid &= result;
+	}
+	return valid;
+}
+
+int main() {
+	std::cout << "cpu simd level: " << simd_level_name(simd_cpu_level()) << "\n";
+	std::cout << "sse4.2 only changes the cell hash (crc32), vector kernels fall back to scalar and are not tested separately\n";
+
+	bool valid = true;
+	valid &= run_test("masked tail", test_masked_tail<simd_scalar_t>, test_masked_tail_avx2, test_masked_tail_avx512);
+	valid &= run_test("reductions", test_reductions<simd_scalar_t>, test_reductions_avx2, test_reductions_avx512);
+	valid &= run_test("rsqrt", test_rsqrt<simd_scalar_t>, test_rsqrt_avx2, test_rsqrt_avx512);
+	valid &= run_test("gather & scatter", test_gather_scatter<simd_scalar_t>, test_gather_scatter_avx2, test_gather_scatter_avx512);
+	valid &= run_test("lane ops", test_lane_ops<simd_scalar_t>, test_lane_ops_avx2, test_lane_ops_avx512);
+	valid &= run_test("add", [] () { simd_force_level(simd_level_t::Scalar); return test_add(); },
+		[] () { simd_force_level(simd_level_t::Avx2); return test_add(); },
+		[] () { simd_force_level(simd_level_t::Avx512); return test_add(); });
+
+	std::cout << (valid ? "all valid" : "some invalid") << "\n";
+	return valid ? 0 : 1;
+}
@@ -13,6 +13,7 @@
 #include <random>
 #include <vector>
 #include <atomic>
+#include <chrono>
 #include <cassert>
 #include <iomanip>
 #include <utility>
@@ -39,6 +40,7 @@
 #include <lofi.hpp>
 #include <utils.hpp>
 #include <dt_timer.hpp>
+#include <task_graph.hpp>
 #include <sparse_cell.hpp>
 #include <thread_pool.hpp>
 
@@ -1226,6 +1228,17 @@ void main() {
 		engine_ctx_t* ctx{};
 	};
 
+	// systems declare what their update functions read & write so mainloop can build the frame task graph
+	// names: "components" (component registry & entity components), "gl_context", state of systems ("physics", "level", ...)
+	// GL context is current on the main thread only, so tasks touching it stay there
+	inline const std::string gl_context = "gl_context";
+
+	inline task_access_t gl_access(task_access_t access) {
+		access.writes.push_back(gl_context);
+		access.main_thread = true;
+		return access;
+	}
+
 	class system_registry_t {
 		using system_storage_t = if_placeholder_t<system_if_t>;
 
@@ -1655,8 +1668,8 @@ void main() {
 
 	class thread_pool_system_t : public system_if_t, public thread_pool_t {
 	public:
-		thread_pool_system_t(engine_ctx_t* ctx, int thread_count)
-			: system_if_t(ctx), thread_pool_t{thread_count} {}
+		thread_pool_system_t(engine_ctx_t* ctx, const thread_pool_settings_t& settings)
+			: system_if_t(ctx), thread_pool_t{settings} {}
 	};
 
 
@@ -1681,6 +1694,11 @@ void main() {
 		void update(tick_t dt) {
 			// TODO
 		}
+
+		// timers are components
+		task_access_t update_access() const {
+			return {.writes = {"components"}};
+		}
 	};
 
 
@@ -1723,6 +1741,11 @@ void main() {
 				sync(entity_t{ctx, handle});
 			}
 		}
+
+		// sync callbacks copy simulation state into entities
+		task_access_t update_access() const {
+			return {.reads = {"physics"}, .writes = {"components"}};
+		}
 	};
 
 
@@ -1785,6 +1808,13 @@ void main() {
 			});
 		}
 
+		// callbacks are executed during update so update touches everything they touch
+		task_access_t update_access() const {
+			task_access_t access = gl_access({.reads = {"components"}});
+			access.merge(callbacks_access);
+			return access;
+		}
+
 		~imgui_system_t() {
 			ImPlot::DestroyContext();
 			ImGui_ImplOpenGL3_Shutdown();
@@ -1871,12 +1901,15 @@ void main() {
 			}
 		}
 
-		void register_callback(gui_callback_t callback) {
+		// access - what callback reads & writes
+		void register_callback(gui_callback_t callback, const task_access_t& access = {}) {
 			callbacks.push_back(std::move(callback));
+			callbacks_access.merge(access);
 		}
 
 	private:
 		std::vector<gui_callback_t> callbacks{};
+		task_access_t callbacks_access{};
 	};
 
 
@@ -2086,6 +2119,11 @@ void main() {
 			}
 		}
 
+		// instances submitted during the previous frame are drawn while the next frame is being filled
+		task_access_t render_prev_frame_access() const {
+			return gl_access({.reads = {"components", "render_prev_frame"}});
+		}
+
 		struct submit_region_t {
 			bool empty() const { return count == 0; }
 
@@ -2118,6 +2156,10 @@ void main() {
 			render_prev_buffer ^= 1;
 		}
 
+		task_access_t finish_next_frame_access() const {
+			return gl_access({.writes = {"render_next_frame", "render_prev_frame"}});
+		}
+
 	private:
 		int max_instances{};
 
@@ -2187,9 +2229,34 @@ void main() {
 	};
 
 
+	// physics is 3D by default, YIN_YANG_PHYSICS_2D builds it for planar scenes (z = 0 plane):
+	// 2D cells & hashes, 8 cell stencil and 2 component force kernels, attractors & forces are projected onto the plane
+#ifdef YIN_YANG_PHYSICS_2D
+	inline constexpr int physics_dim = 2;
+#else
+	inline constexpr int physics_dim = 3;
+#endif
+
+	using physics_vec_t = glm::vec<physics_dim, float>;
+	using physics_cell_t = basic_sparse_cell_t<physics_dim>;
+
+	inline physics_vec_t to_physics_vec(const glm::vec3& v) {
+		return physics_vec_t(v);
+	}
+
+	template<int dim>
+	glm::vec3 to_world_vec(const glm::vec<dim, float>& v) {
+		if constexpr (dim == 2) {
+			return glm::vec3(v, 0.0f);
+		} else {
+			return v;
+		}
+	}
+
 	struct particle_t {
-		glm::vec3 pos{};
-		glm::vec3 vel{};
+		physics_vec_t pos{};
+		physics_vec_t vel{};
+		float size{1.0f}; // radius in units of particle_r
 	};
 
 	struct short_string_t {
@@ -2223,41 +2290,84 @@ void main() {
 		float bounding_r{100.0f};
 		int max_particles{1000};
 		int updates_per_frame{2};
+		int stencil_rings{1}; // cells can be stencil_rings times smaller than the interaction distance
+		bool sphere_stencil{};
 	};
 
 	class strange_particle_system_t : public system_if_t {
 	public:
 		friend class sparse_grid_ops_t;
 
+		// reads cells & hashes computed by ComputeCells phase, particle records are not touched while probing
 		struct sparse_grid_ops_t {
-			sparse_cell_t cell(uint32_t id) const {
-				return get_sparse_cell(ctx->particles[id].pos, ctx->grid_scale);
-			}
-
 			uint32_t hash(uint32_t id) const {
-				return hash(cell(id));
+				return ctx->particle_hashes[id];
 			}
 
-			uint32_t hash(const sparse_cell_t& cell) const {
-				return sparse_cell_hasher_t{}(cell);
+			uint32_t hash(const physics_cell_t& cell) const {
+				return ctx->grid_hash(cell, level);
 			}
 
 			bool equals(uint32_t id1, uint32_t id2) const {
-				return cell(id1) == cell(id2);
+				return ctx->particle_cells[id1] == ctx->particle_cells[id2] && ctx->particle_levels[id1] == ctx->particle_levels[id2];
+			}
+
+			bool equals(uint32_t id, const physics_cell_t& c) const {
+				return ctx->particle_cells[id] == c && ctx->particle_levels[id] == level;
+			}
+
+			void prefetch(uint32_t id) const {
+				lofi_prefetch(&ctx->particle_cells[id]);
+			}
+
+			strange_particle_system_t* ctx{};
+			int level{}; // grid level of looked up cells
+		};
+
+		// same as sparse_grid_ops_t but uses cells particles were registered with in incremental mode
+		// (registered cell differs from the current one until particle is relinked)
+		struct registered_cell_ops_t {
+			uint32_t hash(uint32_t id) const {
+				return ctx->grid_hash(ctx->grid_cells[id], ctx->grid_levels[id]);
 			}
 
-			bool equals(uint32_t id, const sparse_cell_t& c) const {
-				return cell(id) == c;
+			bool equals(uint32_t id1, uint32_t id2) const {
+				return ctx->grid_cells[id1] == ctx->grid_cells[id2] && ctx->grid_levels[id1] == ctx->grid_levels[id2];
 			}
 
 			strange_particle_system_t* ctx{};
 		};
 
-		using sparse_grid_t = lofi_hashtable_t;
+		// wide layout lifts 2^20 items limit of the compact one, generations make reset O(1)
+		// bounded probing lets neighbour lookups (mostly misses) stop early, swap for lofi_generation_hashtable_t to compare
+		using sparse_grid_t = lofi_bounded_generation_hashtable_t;
+		using sparse_grid_hasher_t = sparse_cell_mix_hasher_t; // has batch version, see sparse_cell_hash_many
+		using sparse_grid_bucket_t = sparse_grid_t::bucket_t;
+
+		// hierarchical grid: particle of level L lives in cells 2^L times larger than the base ones (see coarsen_sparse_cell)
+		// all levels share one hashtable, level is a part of the key: hash is salted, level 0 salt is zero
+		static constexpr int max_grid_levels = 8;
+
+		static constexpr uint32_t grid_level_salt(int level) {
+			return (uint32_t)level * 0x9e3779b9u;
+		}
+
+		uint32_t grid_hash(const physics_cell_t& cell, int level) const {
+			return sparse_grid_hasher_t{}(cell) ^ grid_level_salt(level);
+		}
 
 		enum update_phase_t {
+			ComputeCells,
 			ResetHashtable,
 			BuildSparseGrid,
+			BinSparseGrid,
+			BuildPartitionedSparseGrid,
+			LinkSparseGrid,
+			DetectMovedParticles,
+			SumCellCounts,
+			WriteCellOffsets,
+			CompactCells,
+			CrossLevelForces,
 			UpdateCells,
 			UpdatePhaseCount,
 		};
@@ -2265,6 +2375,33 @@ void main() {
 		friend struct update_job_t;
 		friend struct render_submit_t;
 
+		// opt-in sparse grid telemetry, histograms have power of two bins: 1, 2, 3-4, 5-8, ...
+		struct grid_telemetry_t {
+			static constexpr int bins = 16;
+
+			static int bin(uint32_t value) {
+				return std::min<int>(std::bit_width(std::max(value, 1u) - 1), bins - 1);
+			}
+
+			void reset() {
+				*this = grid_telemetry_t{};
+			}
+
+			void merge(const grid_telemetry_t& other) {
+				for (int i = 0; i < bins; i++) {
+					insert_scans[i] += other.insert_scans[i];
+					lookup_scans[i] += other.lookup_scans[i];
+					bucket_counts[i] += other.bucket_counts[i];
+				}
+			}
+
+			uint32_t insert_scans[bins] = {};
+			uint32_t lookup_scans[bins] = {};
+			uint32_t bucket_counts[bins] = {}; // particles per cell
+		};
+
+		static constexpr int telemetry_history_size = 256;
+
 		struct update_job_t : job_if_t {
 			update_job_t(strange_particle_system_t* _ctx, int _job_id)
 				: ctx{_ctx}
@@ -2272,11 +2409,33 @@ void main() {
 			{}
 
 			void execute() override {
-				ctx->execute_job(this);
+				ctx->run_update_job(this);
+			}
+
+			void reset_stats() {
+				neighbour_lookups = 0;
+				filter_rejects = 0;
+				filter_false_positives = 0;
+				cross_level_pairs = 0;
+				pair_tests = 0;
+				pair_hits = 0;
+				telemetry.reset();
 			}
 
 			strange_particle_system_t* ctx{};
 			int job_id{};
+
+			int neighbour_lookups{};
+			int filter_rejects{};
+			int filter_false_positives{};
+			int cross_level_pairs{};
+			int64_t pair_tests{};
+			int64_t pair_hits{}; // pairs within interaction distance
+
+			grid_telemetry_t telemetry{};
+
+			uint32_t cell_count_sum{}; // particles in the cells of the job's range of light_buckets
+			uint32_t cell_offset{}; // offset of the job's first cell
 		};
 
 		struct render_submit_job_t : job_if_t {
@@ -2303,26 +2462,40 @@ void main() {
 			particle_repulse_coef = settings.particle_repulse_coef;
 			catch_radius = settings.catch_radius;
 			bounding_r = settings.bounding_r;
-			max_particles = std::min(settings.max_particles, lofi_max_buckets / 2);
+			max_particles = std::min<uint32_t>(settings.max_particles, sparse_grid_t::max_buckets / 2);
 			updates_per_frame = settings.updates_per_frame;
+			stencil_rings = std::clamp(settings.stencil_rings, 1, max_stencil_rings);
+			sphere_stencil = settings.sphere_stencil;
+			stencil = stencil_t::create(stencil_rings, sphere_stencil);
 			
 			auto* thread_pool = get_ctx()->get_system<thread_pool_system_t>("thread_pool");
 			for (int i = 0; i < thread_pool->worker_count(); i++) {
 				update_jobs.push_back(std::make_unique<update_job_t>(this, i));
+				if (i != 0) {
+					resident_update_jobs.push_back(update_jobs.back().get()); // job 0 is executed by master
+				}
 			}
 			for (int i = 0; i < 1; i++) {
 				render_submit_jobs.push_back(std::make_unique<render_submit_job_t>(this, i));
+				render_submit_job_ptrs.push_back(render_submit_jobs.back().get());
 			}
 
 			auto* imgui = get_ctx()->get_system<imgui_system_t>("imgui");
 			imgui->register_callback([&] (){
 				return draw_ui();
-			});
+			}, {.writes = {"physics"}});
 		}
 
 		double update_elapsed{};
 		double submit_elapsed{};
 
+		// render jobs fill the instance buffer of the next frame
+		// update runs on the main thread: the phase barrier needs every worker for resident jobs,
+		// a pool worker running the update would take one of them away
+		task_access_t update_access() const {
+			return {.writes = {"physics", "render_next_frame"}, .main_thread = true};
+		}
+
 		void update(float dt) {
 			if (particles.empty()) {
 				return;
@@ -2334,21 +2507,63 @@ void main() {
 			}
 
 			prepare_update_buffers();
-			prepare_for_render();
 
 			dispatch_render_jobs();
 
+			for (auto& job : update_jobs) {
+				job->reset_stats();
+			}
+
 			double t0 = glfw::get_time();
+			begin_update_jobs();
 			for (int i = 0; i < updates_per_frame; i++) {
-				reset_update_buffers();
-				dispatch_and_wait_update_jobs(ResetHashtable);
-				dispatch_and_wait_update_jobs(BuildSparseGrid);
+				prepare_grid_levels();
+				dispatch_and_wait_update_jobs(ComputeCells);
+				if (can_update_sparse_grid()) {
+					moved_particles.reset(moved_particles_buffer.data(), particles.size());
+					dispatch_and_wait_update_jobs(DetectMovedParticles);
+					if (!relink_moved_particles()) {
+						rebuild_sparse_grid();
+					}
+				} else {
+					rebuild_sparse_grid();
+				}
+				if (has_cell_offsets()) {
+					compute_cell_offsets();
+				}
+				if (compact_cells) {
+					dispatch_and_wait_update_jobs(CompactCells);
+				}
+				if (telemetry_enabled) {
+					record_grid_load();
+				}
+				if (has_cross_level_forces()) {
+					dispatch_and_wait_update_jobs(CrossLevelForces);
+				}
 				dispatch_and_wait_update_jobs(UpdateCells);
 				apply_updates();
 			}
+			end_update_jobs();
 			double t1 = glfw::get_time();
 			update_elapsed = t1 - t0;
 
+			neighbour_lookups = 0;
+			filter_rejects = 0;
+			filter_false_positives = 0;
+			cross_level_pairs = 0;
+			pair_tests = 0;
+			pair_hits = 0;
+			frame_telemetry.reset();
+			for (auto& job : update_jobs) {
+				neighbour_lookups += job->neighbour_lookups;
+				filter_rejects += job->filter_rejects;
+				filter_false_positives += job->filter_false_positives;
+				cross_level_pairs += job->cross_level_pairs;
+				pair_tests += job->pair_tests;
+				pair_hits += job->pair_hits;
+				frame_telemetry.merge(job->telemetry);
+			}
+
 			wait_render_jobs();
 		}
 
@@ -2365,6 +2580,54 @@ void main() {
 				ImGui::Text("update total: %fs", update_elapsed);
 				ImGui::Text("submit total: %fs", submit_elapsed);
 
+				// forcing a level is safe here: physics uses sparse_cell_mix_hasher_t, its hashes don't depend on the level
+				int level = (int)simd_level();
+				ImGui::Text("simd: %s (cpu: %s)", simd_level_name(simd_level()), simd_level_name(simd_cpu_level()));
+				if (ImGui::Combo("simd level", &level, simd_level_names, (int)simd_cpu_level() + 1)) {
+					simd_force_level((simd_level_t)level);
+				}
+				if (simd_level() == simd_level_t::Sse42) {
+					ImGui::Text("sse4.2 only changes the cell hash, cell & force kernels run scalar");
+				}
+
+				// finer cells with more rings cut pair tests that fail the distance cutoff, at the cost of more cell lookups
+				ImGui::SetNextItemWidth(100.0f);
+				bool stencil_changed = ImGui::SliderInt("stencil rings", &stencil_rings, 1, max_stencil_rings, "%d", ImGuiSliderFlags_AlwaysClamp);
+				ImGui::SameLine();
+				stencil_changed |= ImGui::Checkbox("sphere", &sphere_stencil);
+				if (stencil_changed) {
+					stencil = stencil_t::create(stencil_rings, sphere_stencil);
+				}
+				ImGui::Text("stencil cells: %d, pair test efficiency: %.1f%%", stencil.count, pair_tests ? 100.0 * pair_hits / pair_tests : 0.0);
+
+				ImGui::Checkbox("partitioned sparse grid build", &partitioned_build);
+				ImGui::Checkbox("compact cells", &compact_cells);
+				if (ImGui::Checkbox("occupancy filter", &use_occupancy_filter)) {
+					grid_valid = false;
+				}
+				ImGui::Checkbox("grid telemetry", &telemetry_enabled);
+				if (telemetry_enabled) {
+					draw_telemetry_ui();
+				}
+				if (use_occupancy_filter) {
+					// hit: lookup rejected by the filter, false positive: passed the filter but the cell is empty
+					int negatives = filter_rejects + filter_false_positives;
+					ImGui::Text("filter hit rate: %.1f%%", neighbour_lookups ? 100.0f * filter_rejects / neighbour_lookups : 0.0f);
+					ImGui::Text("filter false positive rate: %.1f%%", negatives ? 100.0f * filter_false_positives / negatives : 0.0f);
+				}
+				if (ImGui::Checkbox("incremental sparse grid", &incremental_grid)) {
+					grid_valid = false;
+				}
+				if (incremental_grid) {
+					ImGui::Text("moved: %d, tombstones: %d, rebuilds: %d", grid_moved, grid_tombstones, grid_rebuilds);
+				}
+				if (ImGui::Checkbox("hierarchical sparse grid", &hierarchical_grid)) {
+					grid_valid = false;
+				}
+				if (hierarchical_grid) {
+					ImGui::Text("occupied levels: %d (top: %d), cross level pairs: %d", std::popcount(occupied_levels), (int)std::bit_width(occupied_levels) - 1, cross_level_pairs);
+				}
+
 				ImGui::PushItemWidth(-1.0f);
 				ImGui::DragFloat("##repulse_coef", &particle_repulse_coef, 1.0f, 0.0f, 1000.0f, "repulse coef: %.1f", ImGuiSliderFlags_AlwaysClamp);
 				ImGui::DragFloat("##dt_step", &dt_step, 0.0001f, 0.0f, 0.1f, "dt step: %.4f", ImGuiSliderFlags_AlwaysClamp);
@@ -2377,7 +2640,7 @@ void main() {
 
 				ImGui::Checkbox("sync grid scale & particle", &sync_grid_scale_n_particle_r);
 				if (sync_grid_scale_n_particle_r) {
-					grid_scale = 0.4f / particle_r;
+					grid_scale = 0.4f * stencil.rings / particle_r;
 				}
 
 				if (ImGui::TreeNode("attractors")) {
@@ -2448,47 +2711,89 @@ void main() {
 		}
 
 
-		void dispatch_update_jobs(update_phase_t phase) {
-			update_phase = phase;
+		void draw_telemetry_ui() {
+			auto plot_histogram = [&] (const char* label, const uint32_t (&histogram)[grid_telemetry_t::bins]) {
+				float values[grid_telemetry_t::bins] = {};
+				for (int i = 0; i < grid_telemetry_t::bins; i++) {
+					values[i] = histogram[i];
+				}
+				ImGui::PlotHistogram(label, values, grid_telemetry_t::bins, 0, nullptr, 0.0f, FLT_MAX, ImVec2{0, 60});
+			};
 
-			auto* thread_pool = get_ctx()->get_system<thread_pool_system_t>("thread_pool");
-			for (auto& job : update_jobs) {
-				thread_pool->push_job(job.get());
-			}
+			const int last = (telemetry_history_top + telemetry_history_size - 1) % telemetry_history_size;
+			ImGui::Text("used buckets: %d / %d", used_buckets_history[last], (int)sparse_grid.get_capacity());
+			ImGui::Text("load factor: %.3f", load_factor_history[last]);
+			ImGui::PlotLines("##load_factor", load_factor_history, telemetry_history_size, telemetry_history_top, "load factor", 0.0f, 1.0f, ImVec2{0, 60});
+			ImGui::Text("bins: 1, 2, 3-4, 5-8, ...");
+			plot_histogram("insert scans", frame_telemetry.insert_scans);
+			plot_histogram("lookup scans", frame_telemetry.lookup_scans);
+			plot_histogram("cell sizes", frame_telemetry.bucket_counts);
 		}
 
-		void wait_update_jobs() {
-			for (auto& job : update_jobs) {
-				job->wait();
+		// master, once per substep after the grid is ready
+		void record_grid_load() {
+			const int used_buckets = light_buckets.allocated();
+			used_buckets_history[telemetry_history_top] = used_buckets;
+			load_factor_history[telemetry_history_top] = (float)used_buckets / sparse_grid.get_capacity();
+			telemetry_history_top = (telemetry_history_top + 1) % telemetry_history_size;
+		}
+
+		void record_insertion(update_job_t* job, sparse_grid_t::insertion_t insertion) {
+			if (telemetry_enabled) {
+				job->telemetry.insert_scans[grid_telemetry_t::bin(insertion.scans() + 1)]++;
 			}
 		}
 
+		// update jobs stay resident for all substeps of the frame: master acts as job 0 and the rest are pushed once,
+		// phases are published through update_phase and separated by update_barrier instead of a fork/join per phase
+		// (resident jobs must be able to start: master must not be a worker itself, so the update is a main thread task of the frame graph,
+		// render jobs never block and waiting for them helps the pool)
+
+		// master
+		void begin_update_jobs() {
+			update_barrier.reset(update_jobs.size());
+
+			auto* thread_pool = get_ctx()->get_system<thread_pool_system_t>("thread_pool");
+			thread_pool->push_jobs(resident_update_jobs, &update_group);
+		}
+
+		// master
+		void end_update_jobs() {
+			update_phase = UpdatePhaseCount;
+			update_barrier.arrive_and_wait();
+			update_group.wait();
+		}
+
+		// master, between begin_update_jobs & end_update_jobs
 		void dispatch_and_wait_update_jobs(update_phase_t phase) {
-			dispatch_update_jobs(phase);
-			wait_update_jobs();
+			update_phase = phase;
+			update_barrier.arrive_and_wait(); // release resident jobs
+			execute_job(update_jobs[0].get());
+			update_barrier.arrive_and_wait(); // all jobs are done with the phase
+		}
+
+		// worker
+		void run_update_job(update_job_t* job) {
+			while (true) {
+				update_barrier.arrive_and_wait();
+				if (update_phase == UpdatePhaseCount) {
+					break;
+				}
+				execute_job(job);
+				update_barrier.arrive_and_wait();
+			}
 		}
 
 		void dispatch_render_jobs() {
 			auto* thread_pool = get_ctx()->get_system<thread_pool_system_t>("thread_pool");
-			for (auto& job : render_submit_jobs) {
-				thread_pool->push_job(job.get());
-			}
+			thread_pool->push_jobs(render_submit_job_ptrs, &render_group);
 		}
 
 		void wait_render_jobs() {
-			for (auto& job : render_submit_jobs) {
-				job->wait();
-			}
+			render_group.wait();
 		}
 
 
-		void prepare_for_render() {
-			const int item_count = particles.size();
-
-			render_jobs_finished = 0;
-			skip_wait_render = false;
-		}
-
 		void prepare_update_buffers() {
 			const int item_count = particles.size();
 			const int bucket_count = nextpow2(item_count) * 2;
@@ -2497,22 +2802,144 @@ void main() {
 
 			next_particle.resize(item_count);
 			sparse_grid_buffer.resize(bucket_count);
+			if constexpr (sparse_grid_t::has_probe_bounds) {
+				sparse_grid_bounds.resize(bucket_count);
+			}
 
 			light_buckets_buffer.resize(item_count);
+
+			particle_cells.resize(item_count);
+			particle_hashes.resize(item_count);
+			particle_levels.resize(item_count);
+			cross_level_acc.resize(item_count);
+
+			// modes can be switched from ui at any moment so buffers are kept ready
+			binned_particles.resize(item_count);
+			overflow_particles_buffer.resize(item_count);
+			bin_offsets.resize(lofi_partition_bins_t::offsets_size(update_jobs.size(), lofi_partition_bins_t::max_partition_log2));
+
+			// 8 bits per particle at least (2 bits per key, cells <= particles), capped to stay cache-resident
+			occupancy_filter_bits_log2 = std::clamp<uint32_t>(std::countr_zero((uint32_t)nextpow2(item_count)) + 3, 12, 21);
+			occupancy_filter_words.resize(lofi_occupancy_filter_t::word_count(occupancy_filter_bits_log2));
+
+			cell_offsets.resize(bucket_count);
+			compact_particles.resize(item_count);
+			compact_ids.resize(item_count);
+
+			prev_particle.resize(item_count);
+			grid_buckets.resize(item_count);
+			grid_cells.resize(item_count);
+			grid_levels.resize(item_count);
+			moved_particles_buffer.resize(item_count);
+		}
+
+		// incremental mode keeps sparse grid between substeps as long as buffers it was built in stay the same
+		bool can_update_sparse_grid() const {
+			return incremental_grid && grid_valid && grid_item_count == particles.size() && grid_scale_built == grid_scale;
 		}
 
-		void reset_update_buffers() {
+		void rebuild_sparse_grid() {
 			const int item_count = particles.size();
 			const int bucket_count = nextpow2(item_count) * 2;
 
-			updated_particles.reset(updated_particles_buffer.data(), item_count);
-			sparse_grid.reset(sparse_grid_buffer.data(), bucket_count, next_particle.data(), item_count);
+			sparse_grid.reset(sparse_grid_buffer.data(), bucket_count, next_particle.data(), item_count, sparse_grid_bounds.data());
 			light_buckets.reset(light_buckets_buffer.data(), item_count);
+
+			if (use_occupancy_filter) {
+				occupancy_filter.reset(occupancy_filter_words.data(), occupancy_filter_bits_log2);
+				occupancy_filter.clear();
+			}
+
+			if constexpr (sparse_grid_t::has_generations) {
+				if (!sparse_grid.advance_generation()) {
+					dispatch_and_wait_update_jobs(ResetHashtable);
+				}
+			} else {
+				dispatch_and_wait_update_jobs(ResetHashtable);
+			}
+			if (partitioned_build) {
+				// several partitions per job so clustered scenes are spread more evenly
+				uint32_t partition_log2 = std::countr_zero((uint32_t)nextpow2(update_jobs.size())) + 2;
+				partition_log2 = std::min<uint32_t>(partition_log2, lofi_partition_bins_t::max_partition_log2);
+				partition_log2 = std::min<uint32_t>(partition_log2, std::countr_zero((uint32_t)bucket_count));
+
+				sparse_grid_bins.reset(binned_particles.data(), bin_offsets.data(), update_jobs.size(), partition_log2);
+				overflow_particles.reset(overflow_particles_buffer.data(), item_count);
+
+				dispatch_and_wait_update_jobs(BinSparseGrid);
+				dispatch_and_wait_update_jobs(BuildPartitionedSparseGrid);
+				put_overflow_particles();
+			} else {
+				dispatch_and_wait_update_jobs(BuildSparseGrid);
+			}
+
+			grid_valid = false;
+			if (incremental_grid) {
+				dispatch_and_wait_update_jobs(LinkSparseGrid);
+
+				grid_valid = true;
+				grid_item_count = item_count;
+				grid_scale_built = grid_scale;
+				grid_tombstones = 0;
+				grid_rebuilds++;
+			}
+		}
+
+		// master
+		// moves particles that changed their cell into the list of the new cell, new cells are appended to light_buckets
+		// returns false if grid must be rebuilt instead
+		bool relink_moved_particles() {
+			auto moved = moved_particles.view_allocated();
+
+			grid_moved = moved.size();
+			if (grid_moved > particles.size() * incremental_grid_max_churn) {
+				return false; // parallel rebuild is cheaper
+			}
+
+			for (int i = 0; i < moved.size(); i++) {
+				uint32_t id = moved[i];
+				if (sparse_grid.unlink(grid_buckets[id], id, prev_particle.data())) {
+					grid_tombstones++;
+				}
+
+				grid_cells[id] = particle_cells[id];
+				grid_levels[id] = particle_levels[id];
+
+				auto insertion = sparse_grid.link(id, prev_particle.data(), registered_cell_ops_t{this});
+				if (!insertion.inserted()) {
+					return false;
+				}
+
+				uint32_t bucket = insertion.bucket();
+				grid_buckets[id] = bucket;
+				record_insertion(update_jobs[0].get(), insertion); // master, jobs are idle
+				add_to_occupancy_filter(id); // cheap if already there, covers reused tombstones
+				if (insertion.new_bucket()) {
+					auto view = light_buckets.allocate(1);
+					if (!view.valid()) {
+						return false;
+					}
+					view[0] = bucket;
+				} else if (sparse_grid_buffer[bucket].count == 1) {
+					grid_tombstones--; // tombstone was reused, it is already in light_buckets
+				}
+			}
+
+			// tombstones lengthen probe sequences and waste update jobs, rebuild on the next substep
+			if (grid_tombstones > particles.size() * incremental_grid_max_tombstones) {
+				grid_valid = false;
+			}
+			return true;
 		}
 
 
 		void execute_job(update_job_t* job) {
 			switch (update_phase) {
+				case ComputeCells: {
+					compute_cells(job);
+					break;
+				}
+
 				case ResetHashtable: {
 					reset_hashtable(job);
 					break;
@@ -2523,22 +2950,122 @@ void main() {
 					break;
 				}
 
+				case BinSparseGrid: {
+					bin_sparse_grid(job);
+					break;
+				}
+
+				case BuildPartitionedSparseGrid: {
+					build_partitioned_sparse_grid(job);
+					break;
+				}
+
+				case LinkSparseGrid: {
+					link_sparse_grid(job);
+					break;
+				}
+
+				case DetectMovedParticles: {
+					detect_moved_particles(job);
+					break;
+				}
+
+				case SumCellCounts: {
+					sum_cell_counts(job);
+					break;
+				}
+
+				case WriteCellOffsets: {
+					write_cell_offsets(job);
+					break;
+				}
+
+				case CompactCells: {
+					compact_cells_job(job);
+					break;
+				}
+
+				case CrossLevelForces: {
+					cross_level_forces(job);
+					break;
+				}
+
 				case UpdateCells: {
 					update_cells(job);
 					break;
 				}
+
+				default: {
+					break;
+				}
+			}
+		}
+
+		void compute_cells(update_job_t* job) {
+			auto [start, stop] = compute_job_range(particles.size(), update_jobs.size(), job->job_id);
+			if (start < stop) {
+				get_sparse_cells(&particles[start].pos, stop - start, grid_scale, &particle_cells[start], &particle_hashes[start], sizeof(particle_t));
+				compute_cell_levels(start, stop);
+			}
+		}
+
+		// master, level L holds particles with size in (level_max_sizes[L - 1], level_max_sizes[L]]
+		void prepare_grid_levels() {
+			occupied_levels = 0;
+
+			const float base_size = stencil.rings / (2.0f * particle_r * grid_scale); // diameter is covered by the stencil of base cells
+			for (int level = 0; level < max_grid_levels; level++) {
+				level_max_sizes[level] = std::ldexp(base_size, level);
+			}
+			level_max_sizes[max_grid_levels - 1] = FLT_MAX; // larger particles are not covered by the neighbourhood of the top level
+		}
+
+		int grid_level(float size) const {
+			int level = 0;
+			while (size > level_max_sizes[level]) {
+				level++;
+			}
+			return level;
+		}
+
+		// particles too large for base cells move to coarser levels, base cells & hashes were computed by get_sparse_cells
+		void compute_cell_levels(int start, int stop) {
+			if (!hierarchical_grid) {
+				std::memset(&particle_levels[start], 0x00, (stop - start) * sizeof(uint8_t));
+				std::atomic_ref<uint32_t>{occupied_levels}.fetch_or(1, std::memory_order_relaxed);
+				return;
+			}
+
+			uint32_t levels = 0;
+			for (int id = start; id < stop; id++) {
+				const int level = grid_level(particles[id].size);
+				particle_levels[id] = level;
+				levels |= 1u << level;
+				if (level != 0) {
+					particle_cells[id] = coarsen_sparse_cell(particle_cells[id], level);
+					particle_hashes[id] = grid_hash(particle_cells[id], level);
+				}
+				cross_level_acc[id] = physics_vec_t{};
 			}
+			std::atomic_ref<uint32_t>{occupied_levels}.fetch_or(levels, std::memory_order_relaxed);
+		}
+
+		bool has_cross_level_forces() const {
+			return std::popcount(occupied_levels) > 1;
 		}
 
 		void reset_hashtable(update_job_t* job) {
 			auto [start, stop] = compute_job_range(sparse_grid_buffer.size(), update_jobs.size(), job->job_id);
 			auto count = stop - start;
 			if (count > 0) {
-				std::memset(sparse_grid_buffer.data() + start, 0x00, count * sizeof(lofi_bucket_t));
+				std::memset(sparse_grid_buffer.data() + start, 0x00, count * sizeof(sparse_grid_bucket_t));
+				if constexpr (sparse_grid_t::has_probe_bounds) {
+					std::memset(sparse_grid_bounds.data() + start, 0x00, count * sizeof(lofi_probe_bound_t));
+				}
 			}
 		}
 
-		struct bucket_batch_t {
+		struct index_batch_t {
 			static constexpr int capacity = 256;
 
 			bool push(uint32_t item) {
@@ -2573,22 +3100,29 @@ void main() {
 			uint32_t _data[capacity] = {};
 		};
 
+		void flush_batch(lofi_stack_alloc_t<uint32_t>& alloc, index_batch_t& batch) {
+			auto view = alloc.allocate(batch.count());
+			assert(view.valid());
+			std::memcpy(view.data(), batch.data(), batch.byte_size());
+			batch.reset();
+		}
+
 		void build_sparse_grid(update_job_t* job) {
-			bucket_batch_t buckets{};
+			index_batch_t buckets{};
 
 			auto flush_buckets = [&] () {
-				auto view = light_buckets.allocate(buckets.count());
-				assert(view.valid());
-				std::memcpy(view.data(), buckets.data(), buckets.byte_size());
-				buckets.reset();
+				flush_batch(light_buckets, buckets);
 			};
 
 			auto [start, stop] = compute_job_range(particles.size(), update_jobs.size(), job->job_id);
 			for (int item = start; item < stop; item++) {
-				lofi_insertion_t insertion = sparse_grid.put(item, sparse_grid_ops_t{this});
+				auto insertion = sparse_grid.put(item, sparse_grid_ops_t{this});
 				assert(insertion.inserted());
+				record_insertion(job, insertion);
 
 				if (insertion.new_bucket()) {
+					add_to_occupancy_filter(item);
+
 					uint32_t bucket = insertion.bucket();
 					if (buckets.push(bucket)) {
 						continue;
@@ -2602,92 +3136,255 @@ void main() {
 			}
 		}
 
-		static constexpr const sparse_cell_t neighbour_offsets[26] = {
-			sparse_cell_t{-1, -1, -1},
-			sparse_cell_t{0, -1, -1},
-			sparse_cell_t{1, -1, -1},
-			sparse_cell_t{-1, 0, -1},
-			sparse_cell_t{0, 0, -1},
-			sparse_cell_t{1, 0, -1},
-			sparse_cell_t{-1, 1, -1},
-			sparse_cell_t{0, 1, -1},
-			sparse_cell_t{1, 1, -1},
-
-			sparse_cell_t{-1, -1, 0},
-			sparse_cell_t{0, -1, 0},
-			sparse_cell_t{1, -1, 0},
-			sparse_cell_t{-1, 0, 0},
-			sparse_cell_t{1, 0, 0},
-			sparse_cell_t{-1, 1, 0},
-			sparse_cell_t{0, 1, 0},
-			sparse_cell_t{1, 1, 0},
-
-			sparse_cell_t{-1, -1, 1},
-			sparse_cell_t{0, -1, 1},
-			sparse_cell_t{1, -1, 1},
-			sparse_cell_t{-1, 0, 1},
-			sparse_cell_t{0, 0, 1},
-			sparse_cell_t{1, 0, 1},
-			sparse_cell_t{-1, 1, 1},
-			sparse_cell_t{0, 1, 1},
-			sparse_cell_t{1, 1, 1},
-		};
-
-		static constexpr int total_neighbours = 26;
-
-		/*static constexpr const sparse_cell_t neighbour_offsets[6] = {
-			sparse_cell_t{+1, 0, 0},
-			sparse_cell_t{-1, 0, 0},
-			sparse_cell_t{0, +1, 0},
-			sparse_cell_t{0, -1, 0},
-			sparse_cell_t{0, 0, +1},
-			sparse_cell_t{0, 0, -1},
-		};
+		void bin_sparse_grid(update_job_t* job) {
+			const uint32_t partition_log2 = sparse_grid_bins.partition_log2;
 
-		static constexpr int total_neighbours = 6;*/
+			auto [start, stop] = compute_job_range(particles.size(), update_jobs.size(), job->job_id);
+			sparse_grid_bins.bin(job->job_id, start, stop, [&] (uint32_t id) {
+				return sparse_grid.get_partition(particle_hashes[id], partition_log2);
+			});
+		}
 
-		struct neighbour_lookup_t {
-			struct lookup_t {
-				uint32_t head{};
-				uint32_t count{};
-			};
+		// every partition is owned by a single job, so buckets of dense cells are not contended
+		void build_partitioned_sparse_grid(update_job_t* job) {
+			const uint32_t partition_log2 = sparse_grid_bins.partition_log2;
+			const int total_jobs = update_jobs.size();
 
-			void push(uint32_t _head, uint32_t _count) {
-				lookups[count++] = {_head, _count};
+			index_batch_t buckets{};
+			index_batch_t overflow{};
+
+			for (uint32_t partition = job->job_id; partition < sparse_grid_bins.partition_count(); partition += total_jobs) {
+				for (int binning_job = 0; binning_job < total_jobs; binning_job++) {
+					auto items = sparse_grid_bins.view(binning_job, partition);
+					for (int i = 0; i < items.size(); i++) {
+						uint32_t item = items[i];
+
+						auto insertion = sparse_grid.put_partitioned(item, partition_log2, sparse_grid_ops_t{this});
+						record_insertion(job, insertion);
+						if (!insertion.inserted()) {
+							if (!overflow.push(item)) {
+								flush_batch(overflow_particles, overflow);
+								overflow.push(item); // guaranteed to succeed
+							}
+						} else if (insertion.new_bucket()) {
+							add_to_occupancy_filter(item);
+							if (!buckets.push(insertion.bucket())) {
+								flush_batch(light_buckets, buckets);
+								buckets.push(insertion.bucket()); // guaranteed to succeed
+							}
+						}
+					}
+				}
+			}
+			if (!buckets.empty()) {
+				flush_batch(light_buckets, buckets);
+			}
+			if (!overflow.empty()) {
+				flush_batch(overflow_particles, overflow);
 			}
+		}
 
-			lookup_t center() const { return lookups[0]; }
+		// mt function, marks cell of the particle as occupied
+		void add_to_occupancy_filter(uint32_t id) {
+			if (use_occupancy_filter) {
+				occupancy_filter.insert(particle_hashes[id]);
+			}
+		}
 
-			int count{};
-			lookup_t lookups[total_neighbours + 1] = {}; // + center cell
-		};
+		// master, particles that didn't fit into their partition
+		void put_overflow_particles() {
+			auto overflow = overflow_particles.view_allocated();
+			for (int i = 0; i < overflow.size(); i++) {
+				auto insertion = sparse_grid.put(overflow[i], sparse_grid_ops_t{this});
+				assert(insertion.inserted());
+				record_insertion(update_jobs[0].get(), insertion); // master, jobs are idle
 
-		static constexpr int update_batch_size = 128;
+				if (insertion.new_bucket()) {
+					add_to_occupancy_filter(overflow[i]);
 
-		void update_cells(update_job_t* job) {
-			// simpler version
-			/*auto [start, stop] = compute_job_range(light_buckets.allocated(), update_jobs.size(), job->job_id);
-			if (start >= stop) {
-				return;
+					auto view = light_buckets.allocate(1);
+					assert(view.valid());
+					view[0] = insertion.bucket();
+				}
 			}
+		}
 
-			auto updated_buckets = light_buckets.view(start, stop - start);
-
-			int total_particles_count = 0;
-			for (int i = 0; i < updated_buckets.size(); i++) {
-				total_particles_count += sparse_grid_buffer[updated_buckets[i]].count;
+		// incremental mode: fills prev links, registered bucket & cell of every particle after the grid was built
+		void link_sparse_grid(update_job_t* job) {
+			auto [start, stop] = compute_job_range(light_buckets.allocated(), update_jobs.size(), job->job_id);
+			for (int i = start; i < stop; i++) {
+				const uint32_t bucket_index = light_buckets_buffer[i];
+				const uint32_t head = sparse_grid_buffer[bucket_index].head();
+				const physics_cell_t cell = particle_cells[head];
+				const uint8_t level = particle_levels[head];
+
+				uint32_t prev = head;
+				for (auto it = lofi_flat_list_walker_t{next_particle.data(), (uint32_t)next_particle.size(), head}; it.valid(); it.next()) {
+					uint32_t id = it.get();
+					prev_particle[id] = prev;
+					grid_buckets[id] = bucket_index;
+					grid_cells[id] = cell;
+					grid_levels[id] = level;
+					prev = id;
+				}
 			}
+		}
 
-			auto update_buffer = updated_particles.allocate(total_particles_count);
-			for (int i = 0; i < updated_buckets.size(); i++) {
-				const lofi_bucket_t bucket = sparse_grid_buffer[updated_buckets[i]];
-				const neighbour_lookup_t lookup = do_neighbour_lookup(bucket.head(), bucket.count);
+		// incremental mode: collects particles whose cell (or level) differs from the registered one
+		void detect_moved_particles(update_job_t* job) {
+			index_batch_t moved{};
+
+			auto [start, stop] = compute_job_range(particles.size(), update_jobs.size(), job->job_id);
+			for (int id = start; id < stop; id++) {
+				if (particle_cells[id] == grid_cells[id] && particle_levels[id] == grid_levels[id]) {
+					continue;
+				}
+				if (!moved.push(id)) {
+					flush_batch(moved_particles, moved);
+					moved.push(id); // guaranteed to succeed
+				}
+			}
+			if (!moved.empty()) {
+				flush_batch(moved_particles, moved);
+			}
+		}
+
+		// incremental mode scatters results by id, otherwise results of a cell are written at its offset
+		bool has_cell_offsets() const {
+			return compact_cells || !incremental_grid;
+		}
+
+		// master, between begin_update_jobs & end_update_jobs, cells are laid out contiguously in order of light_buckets
+		// exclusive scan as two phases of the resident jobs (workers are held by the barrier, pool jobs would run on master only):
+		// every job sums counts of its range, master scans job totals, every job writes offsets of its range
+		void compute_cell_offsets() {
+			dispatch_and_wait_update_jobs(SumCellCounts);
+
+			uint32_t offset = 0;
+			for (auto& job : update_jobs) {
+				job->cell_offset = offset;
+				offset += job->cell_count_sum;
+			}
+			assert(offset == particles.size());
+
+			dispatch_and_wait_update_jobs(WriteCellOffsets);
+		}
+
+		void sum_cell_counts(update_job_t* job) {
+			auto [start, stop] = compute_job_range(light_buckets.allocated(), update_jobs.size(), job->job_id);
+			uint32_t sum = 0;
+			for (int i = start; i < stop; i++) {
+				sum += sparse_grid_buffer[light_buckets_buffer[i]].count;
+			}
+			job->cell_count_sum = sum;
+		}
+
+		void write_cell_offsets(update_job_t* job) {
+			auto [start, stop] = compute_job_range(light_buckets.allocated(), update_jobs.size(), job->job_id);
+			uint32_t offset = job->cell_offset;
+			for (int i = start; i < stop; i++) {
+				const uint32_t bucket_index = light_buckets_buffer[i];
+				cell_offsets[bucket_index] = offset;
+				offset += sparse_grid_buffer[bucket_index].count;
+			}
+		}
+
+		// converts cell lists into contiguous ranges: particles of a cell are compact_particles[offset, offset + count)
+		void compact_cells_job(update_job_t* job) {
+			auto [start, stop] = compute_job_range(light_buckets.allocated(), update_jobs.size(), job->job_id);
+			for (int i = start; i < stop; i++) {
+				const uint32_t bucket_index = light_buckets_buffer[i];
+				const sparse_grid_bucket_t bucket = sparse_grid_buffer[bucket_index];
+				if (bucket.count == 0) {
+					continue; // tombstone
+				}
+
+				uint32_t offset = cell_offsets[bucket_index];
+				for (auto it = lofi_flat_list_walker_t{next_particle.data(), (uint32_t)next_particle.size(), bucket.head()}; it.valid(); it.next()) {
+					compact_particles[offset] = particles[it.get()];
+					compact_ids[offset] = it.get();
+					offset++;
+				}
+			}
+		}
+
+		static constexpr int max_stencil_rings = 3;
+		static constexpr int max_stencil_side = 2 * max_stencil_rings + 1;
+		static constexpr int max_neighbours = (physics_dim == 2 ? max_stencil_side * max_stencil_side : max_stencil_side * max_stencil_side * max_stencil_side) - 1;
+
+		// offsets of neighbour cells within `rings` cells of the center one, x runs fastest
+		// sphere pruning drops cells whose closest point is at least `rings` cells away: no pair there is within interaction distance
+		struct stencil_t {
+			static stencil_t create(int rings, bool sphere) {
+				const int side = 2 * rings + 1;
+
+				int cells = 1;
+				for (int d = 0; d < physics_dim; d++) {
+					cells *= side;
+				}
+
+				stencil_t stencil{};
+				stencil.rings = rings;
+				for (int k = 0; k < cells; k++) {
+					physics_cell_t offset{};
+					int gap2 = 0;
+					for (int d = 0, rest = k; d < physics_dim; d++, rest /= side) {
+						offset[d] = rest % side - rings;
+						const int gap = std::max(std::abs(offset[d]) - 1, 0);
+						gap2 += gap * gap;
+					}
+					if (offset == physics_cell_t{}) {
+						continue;
+					}
+					if (sphere && gap2 >= rings * rings) {
+						continue;
+					}
+					stencil.offsets[stencil.count++] = offset;
+				}
+				return stencil;
+			}
+
+			int rings{};
+			int count{};
+			physics_cell_t offsets[max_neighbours] = {};
+		};
+
+		struct neighbour_lookup_t {
+			struct lookup_t {
+				uint32_t head{};
+				uint32_t count{};
+				uint32_t offset{}; // compact cells only
+			};
+
+			void push(uint32_t _head, uint32_t _count, uint32_t _offset) {
+				lookups[count++] = {_head, _count, _offset};
+			}
+
+			lookup_t center() const { return lookups[0]; }
+
+			int count{};
+			lookup_t lookups[max_neighbours + 1]; // + center cell
+		};
+
+		static constexpr int update_batch_size = 128;
+
+		void update_cells(update_job_t* job) {
+			// simpler version
+			/*auto [start, stop] = compute_job_range(light_buckets.allocated(), update_jobs.size(), job->job_id);
+			if (start >= stop) {
+				return;
+			}
+
+			auto updated_buckets = light_buckets.view(start, stop - start);
+			for (int i = 0; i < updated_buckets.size(); i++) {
+				const sparse_grid_bucket_t bucket = sparse_grid_buffer[updated_buckets[i]];
+				const neighbour_lookup_t lookup = do_neighbour_lookup(job, bucket.head(), bucket.count, 0);
 
 				int pstart = 0;
 				int pstop = bucket.count;
 				while (pstart < pstop) {
 					int batch_size = std::min(update_batch_size, pstop - pstart);
-					update_cell(lookup, update_buffer.bite(batch_size), pstart);
+					update_cell(lookup, pstart, batch_size, lofi_create_view(updated_particles_buffer.data(), cell_offsets[updated_buckets[i]] + pstart, batch_size));
 					pstart += batch_size;
 				}
 			}*/
@@ -2698,11 +3395,15 @@ void main() {
 
 			auto updated_buckets = light_buckets.view_allocated();
 
-			int total_updated_particles = 0;
+			// incremental mode keeps particle ids stable so results are scattered by id
+			// otherwise results are written at the offset of the cell (compute_cell_offsets scan), so particles end up sorted by cell
+			const bool write_at_offsets = !incremental_grid;
 			{
+				neighbour_lookup_t lookup{};
+
 				int curr_batch_id = job_id;
 				for (int i = 0; i < updated_buckets.size(); i++) {
-					const lofi_bucket_t bucket = sparse_grid_buffer[updated_buckets[i]];
+					const sparse_grid_bucket_t bucket = sparse_grid_buffer[updated_buckets[i]];
 
 					int start = 0;
 					int stop = bucket.count;
@@ -2712,61 +3413,149 @@ void main() {
 							curr_batch_id -= total_jobs;
 						}
 						if (curr_batch_id == 0) {
-							total_updated_particles += batch_size;
+							if (telemetry_enabled && start == 0) {
+								job->telemetry.bucket_counts[grid_telemetry_t::bin(bucket.count)]++;
+							}
+							if (lookup.count == 0 || lookup.center().head != bucket.head()) {
+								do_neighbour_lookup(job, lookup, bucket.head(), bucket.count, compact_cells ? cell_offsets[updated_buckets[i]] : 0);
+							}
+
+							lofi_view_t<particle_t> batch_output{};
+							if (write_at_offsets) {
+								batch_output = lofi_create_view(updated_particles_buffer.data(), cell_offsets[updated_buckets[i]] + start, batch_size);
+							}
+							update_cell(job, lookup, start, batch_size, batch_output);
 						}
 						curr_batch_id++;
 						start += batch_size;
 					}
 				}
 			}
+		}
 
-			auto update_buffer = updated_particles.allocate(total_updated_particles);
-			{
-				neighbour_lookup_t lookup{};
+		void do_neighbour_lookup(update_job_t* job, neighbour_lookup_t& lookup, uint32_t center_head, uint32_t center_count, uint32_t center_offset) {
+			const physics_cell_t center = particle_cells[center_head];
 
-				int curr_batch_id = job_id;
-				for (int i = 0; i < updated_buckets.size(); i++) {
-					const lofi_bucket_t bucket = sparse_grid_buffer[updated_buckets[i]];
+			physics_cell_t neighbours[max_neighbours];
+			for (int i = 0; i < stencil.count; i++) {
+				neighbours[i] = center + stencil.offsets[i];
+			}
 
-					int start = 0;
-					int stop = bucket.count;
-					while (start < stop) {
-						int batch_size = std::min(update_batch_size, stop - start);
-						if (curr_batch_id >= total_jobs) {
-							curr_batch_id -= total_jobs;
-						}
-						if (curr_batch_id == 0) {
-							if (lookup.count == 0 || lookup.center().head != bucket.head()) {
-								lookup = do_neighbour_lookup(bucket.head(), bucket.count);
-							}
-							update_cell(lookup, update_buffer.bite(batch_size), start);
-						}
-						curr_batch_id++;
-						start += batch_size;
+			sparse_grid_t::search_result_t results[max_neighbours];
+			const int neighbour_count = find_cells(job, particle_levels[center_head], neighbours, stencil.count, results);
+
+			lookup.count = 0;
+			lookup.push(center_head, center_count, center_offset);
+			for (int i = 0; i < neighbour_count; i++) {
+				if (results[i].valid()) {
+					lookup.push(results[i].head(), results[i].bucket.count, compact_cells ? cell_offsets[results[i].bucket_index] : 0);
+				}
+			}
+		}
+
+		// looks up cells of the given level, cells rejected by the occupancy filter are dropped (cells are compacted in place)
+		// returns count of looked up cells, results are parallel to compacted cells
+		int find_cells(update_job_t* job, int level, physics_cell_t* cells, int count, sparse_grid_t::search_result_t* results) {
+			// all hashes are computed in one batch
+			uint32_t hashes[max_neighbours + 1];
+			assert(count <= max_neighbours + 1);
+			sparse_cell_hash_many(cells, count, hashes);
+			if (level != 0) {
+				for (int i = 0; i < count; i++) {
+					hashes[i] ^= grid_level_salt(level);
+				}
+			}
+
+			// cells rejected by the occupancy filter are surely empty, bucket memory is not touched for them
+			int found_count = count;
+			if (use_occupancy_filter) {
+				found_count = 0;
+				for (int i = 0; i < count; i++) {
+					if (occupancy_filter.may_contain(hashes[i])) {
+						cells[found_count] = cells[i];
+						hashes[found_count] = hashes[i];
+						found_count++;
 					}
 				}
 			}
+
+			sparse_grid.get_many(cells, hashes, found_count, results, sparse_grid_ops_t{this, level});
+
+			for (int i = 0; i < found_count; i++) {
+				if (telemetry_enabled) {
+					job->telemetry.lookup_scans[grid_telemetry_t::bin(results[i].scans + 1)]++;
+				}
+				if (!results[i].valid() && use_occupancy_filter) {
+					job->filter_false_positives++;
+				}
+			}
+
+			job->neighbour_lookups += count;
+			job->filter_rejects += count - found_count;
+			return found_count;
 		}
 
-		neighbour_lookup_t do_neighbour_lookup(uint32_t center_head, uint32_t center_count) {
-			const sparse_cell_t center = get_sparse_cell(particles[center_head].pos, grid_scale);
+		// hierarchical grid: forces between particles of different levels are found from the smaller particle
+		// in the stencil around it on every coarser occupied level (cells there are large enough for both radii),
+		// reaction goes to the larger particle, both are accumulated atomically as larger particles are shared by jobs
+		void cross_level_forces(update_job_t* job) {
+			physics_cell_t cells[max_neighbours + 1];
+			sparse_grid_t::search_result_t results[max_neighbours + 1];
+
+			auto [start, stop] = compute_job_range(particles.size(), update_jobs.size(), job->job_id);
+			for (int id = start; id < stop; id++) {
+				const uint32_t coarser_levels = occupied_levels & ~((2u << particle_levels[id]) - 1);
+				if (coarser_levels == 0) {
+					continue;
+				}
+
+				const particle_t& particle = particles[id];
+				const physics_cell_t base_cell = get_sparse_cell(particle.pos, grid_scale);
 
-			neighbour_lookup_t lookup{};
-			lookup.push(center_head, center_count);
-			for (auto& offset : neighbour_offsets) {
-				const sparse_cell_t neighbour = center + offset;
-				const lofi_search_result_t result = sparse_grid.get(neighbour, sparse_grid_ops_t{this});
-				if (result.valid()) {
-					lookup.push(result.head(), result.bucket.count);
+				physics_vec_t acc{};
+				for (uint32_t levels = coarser_levels; levels != 0; levels &= levels - 1) {
+					const int level = std::countr_zero(levels);
+
+					const physics_cell_t center = coarsen_sparse_cell(base_cell, level);
+					cells[0] = center;
+					for (int i = 0; i < stencil.count; i++) {
+						cells[i + 1] = center + stencil.offsets[i];
+					}
+
+					const int found_count = find_cells(job, level, cells, stencil.count + 1, results);
+					for (int i = 0; i < found_count; i++) {
+						if (!results[i].valid()) {
+							continue;
+						}
+						for (auto it = lofi_flat_list_walker_t{next_particle.data(), (uint32_t)next_particle.size(), results[i].head()}; it.valid(); it.next()) {
+							const particle_t& other = particles[it.get()];
+							const physics_vec_t other_acc = particle_force_on_by(particle.pos, other.pos, particle_r * (particle.size + other.size));
+							acc += other_acc;
+							atomic_add(cross_level_acc[it.get()], -other_acc);
+							job->cross_level_pairs++;
+						}
+					}
 				}
+				atomic_add(cross_level_acc[id], acc);
 			}
-			return lookup;
 		}
 
-		void update_cell(const neighbour_lookup_t& lookup, lofi_view_t<particle_t> update_buffer, int start) {
-			const int curr_batch_size = update_buffer.size();
+		// mt function
+		static void atomic_add(physics_vec_t& dst, const physics_vec_t& value) {
+			for (int d = 0; d < physics_dim; d++) {
+				std::atomic_ref<float>{dst[d]}.fetch_add(value[d], std::memory_order_relaxed);
+			}
+		}
 
+		// results are written into update_buffer if it is valid, otherwise scattered into updated_particles_buffer by id
+		void update_cell(update_job_t* job, const neighbour_lookup_t& lookup, int start, int curr_batch_size, lofi_view_t<particle_t> update_buffer) {
 			assert(curr_batch_size <= update_batch_size);
+			assert(!update_buffer.valid() || update_buffer.size() == curr_batch_size);
+
+			particle_t local_batch[update_batch_size];
+			uint32_t batch_ids[update_batch_size];
+
+			particle_t* batch = update_buffer.valid() ? update_buffer.data() : local_batch;
 
 			auto create_iter = [&] (uint32_t head, int skip = -1) {
 				auto iter = lofi_flat_list_walker_t{next_particle.data(), (uint32_t)next_particle.size(), head};
@@ -2776,46 +3565,82 @@ void main() {
 				return iter;
 			};
 
-			int curr = 0;
-			int rem = curr_batch_size;
-			for (auto it = create_iter(lookup.center().head, start); rem > 0; rem--, it.next()) {
-				update_buffer[curr++] = particles[it.get()];
+			if (compact_cells) {
+				const uint32_t first = lookup.center().offset + start;
+				std::memcpy(batch_ids, &compact_ids[first], curr_batch_size * sizeof(uint32_t));
+				std::memcpy(batch, &compact_particles[first], curr_batch_size * sizeof(particle_t));
+			} else {
+				int curr = 0;
+				int rem = curr_batch_size;
+				for (auto it = create_iter(lookup.center().head, start); rem > 0; rem--, it.next()) {
+					batch_ids[curr] = it.get();
+					batch[curr++] = particles[it.get()];
+				}
 			}
 
-			glm::vec3 acc_buffer[update_batch_size] = {};
+			physics_vec_t acc_buffer[update_batch_size] = {};
 
+			int64_t pair_tests = curr_batch_size * (curr_batch_size - 1) / 2;
+			int64_t pair_hits = 0;
 			for (int i = 0; i < curr_batch_size; i++) {
 				for (int j = i + 1; j < curr_batch_size; j++) {
-					glm::vec3 acc = particle_force_on_by(update_buffer[i].pos, update_buffer[j].pos);
+					physics_vec_t acc = particle_force_on_by(batch[i].pos, batch[j].pos, particle_r * (batch[i].size + batch[j].size));
 					acc_buffer[i] += acc;
 					acc_buffer[j] -= acc;
+					pair_hits += acc != physics_vec_t{}; // zero force only out of range (or for coincident particles)
 				}
 			}
 
+			// forces from neighbour cells are accumulated by vector kernels over the whole batch
+			const simd_level_t level = simd_level();
+			const force_params_t params{eps, particle_repulse_coef};
+			force_batch_t force_batch;
+			force_batch.load(batch, curr_batch_size, particle_r);
 			for (int l = 1; l < lookup.count; l++) {
-				for (auto it = create_iter(lookup.lookups[l].head); it.valid(); it.next()) {
-					for (int i = 0; i < curr_batch_size; i++) {
-						acc_buffer[i] += particle_force_on_by(update_buffer[i].pos, particles[it.get()].pos);
+				pair_tests += (int64_t)curr_batch_size * lookup.lookups[l].count;
+				if (compact_cells) {
+					const particle_t* cell = &compact_particles[lookup.lookups[l].offset];
+					for (uint32_t k = 0; k < lookup.lookups[l].count; k++) {
+						pair_hits += accumulate_forces(level, params, force_batch, curr_batch_size, cell[k].pos, particle_r * cell[k].size);
+					}
+				} else {
+					for (auto it = create_iter(lookup.lookups[l].head); it.valid(); it.next()) {
+						const particle_t& other = particles[it.get()];
+						pair_hits += accumulate_forces(level, params, force_batch, curr_batch_size, other.pos, particle_r * other.size);
 					}
 				}
 			}
+			job->pair_tests += pair_tests;
+			job->pair_hits += pair_hits;
 
+			const bool add_cross_level_acc = has_cross_level_forces();
 			for (int i = 0; i < curr_batch_size; i++) {
-				auto& updated_particle = update_buffer[i];
-				std::tie(updated_particle.pos, updated_particle.vel) = integrate_motion(updated_particle.pos, updated_particle.vel, acc_buffer[i] + env_force(updated_particle.pos, updated_particle.vel));
+				auto& updated_particle = batch[i];
+				physics_vec_t acc = acc_buffer[i] + force_batch.acc(i);
+				if (add_cross_level_acc) {
+					acc += cross_level_acc[batch_ids[i]];
+				}
+				std::tie(updated_particle.pos, updated_particle.vel) = integrate_motion(updated_particle.pos, updated_particle.vel, acc + env_force(updated_particle.pos, updated_particle.vel));
+			}
+
+			if (!update_buffer.valid()) {
+				for (int i = 0; i < curr_batch_size; i++) {
+					updated_particles_buffer[batch_ids[i]] = batch[i];
+				}
 			}
 		}
 
-		glm::vec3 particle_force_on_by(const glm::vec3& on, const glm::vec3& by) {
-			glm::vec3 dr = on - by;
+		// max_r: sum of radii
+		physics_vec_t particle_force_on_by(const physics_vec_t& on, const physics_vec_t& by, float max_r) {
+			physics_vec_t dr = on - by;
 			float r = glm::dot(dr, dr);
 			if (r < eps) {
-				return glm::vec3{};
+				return physics_vec_t{};
 			}
 
 			r = std::sqrt(r);
-			if (r >= 2.0f * particle_r) {
-				return glm::vec3{};
+			if (r >= max_r) {
+				return physics_vec_t{};
 			}
 
 			float ri = 1.0f / r;
@@ -2829,10 +3654,115 @@ void main() {
 			//return (k * dl) * dr; // spring-like
 		}
 
-		glm::vec3 env_force(const glm::vec3& pos, const glm::vec3& vel) {
-			glm::vec3 acc{};
+		// parameters of particle_force_on_by for vector kernels
+		struct force_params_t {
+			float eps{};
+			float coef{};
+		};
+
+		// SoA copy of batch positions, radii & accumulated accelerations, one array per component
+		struct force_batch_t {
+			void load(const particle_t* batch, int count, float particle_r) {
+				for (int i = 0; i < count; i++) {
+					for (int d = 0; d < physics_dim; d++) {
+						positions[d][i] = batch[i].pos[d];
+					}
+					rad[i] = particle_r * batch[i].size;
+				}
+				std::memset(accelerations, 0x00, sizeof(accelerations));
+			}
+
+			physics_vec_t pos(int i) const {
+				physics_vec_t p{};
+				for (int d = 0; d < physics_dim; d++) {
+					p[d] = positions[d][i];
+				}
+				return p;
+			}
+
+			physics_vec_t acc(int i) const {
+				physics_vec_t a{};
+				for (int d = 0; d < physics_dim; d++) {
+					a[d] = accelerations[d][i];
+				}
+				return a;
+			}
+
+			alignas(64) float positions[physics_dim][update_batch_size];
+			alignas(64) float rad[update_batch_size];
+			alignas(64) float accelerations[physics_dim][update_batch_size];
+		};
+
+		// acc(i) += particle_force_on_by(pos(i), by, rad(i) + by_r) for every particle of the batch
+		// returns count of particles within interaction distance
+		int accumulate_forces(simd_level_t level, const force_params_t& params, force_batch_t& batch, int count, const physics_vec_t& by, float by_r) {
+			switch (level) {
+				case simd_level_t::Avx512:
+					return accumulate_forces16(params, batch, count, by, by_r);
+				case simd_level_t::Avx2:
+					return accumulate_forces8(params, batch, count, by, by_r);
+				default:
+					return accumulate_forces_kernel<simd_scalar_t>(params, batch, count, by, by_r);
+			}
+		}
+
+		// same math as particle_force_on_by, whole vectors then one masked tail
+		template<class v_t>
+		YIN_YANG_FORCE_INLINE static int accumulate_forces_kernel(const force_params_t& params, force_batch_t& batch, int count, const physics_vec_t& by, float by_r) {
+			int hits = 0;
+			int i = 0;
+			for (; i + v_t::lanes <= count; i += v_t::lanes) {
+				hits += accumulate_forces_lanes<v_t, false>(params, batch, i, by, by_r, v_t::tail_mask(v_t::lanes));
+			}
+			if (i < count) {
+				hits += accumulate_forces_lanes<v_t, true>(params, batch, i, by, by_r, v_t::tail_mask(count - i));
+			}
+			return hits;
+		}
+
+		template<class v_t, bool masked>
+		YIN_YANG_FORCE_INLINE static int accumulate_forces_lanes(const force_params_t& params, force_batch_t& batch, int i, const physics_vec_t& by, float by_r, typename v_t::mask_t tail) {
+			using f32 = typename v_t::f32;
+
+			auto load = [tail] (const float* p) {
+				return masked ? v_t::load(p, tail) : v_t::load(p);
+			};
+			auto store = [tail] (float* p, f32 v) {
+				masked ? v_t::store(p, v, tail) : v_t::store(p, v);
+			};
+
+			f32 dr[physics_dim];
+			for (int d = 0; d < physics_dim; d++) {
+				dr[d] = v_t::sub(load(batch.positions[d] + i), v_t::set1(by[d]));
+			}
+			f32 r2 = v_t::mul(dr[0], dr[0]);
+			for (int d = 1; d < physics_dim; d++) {
+				r2 = v_t::add(r2, v_t::mul(dr[d], dr[d]));
+			}
+			const f32 r = v_t::sqrt(r2);
+			const f32 max_r = v_t::add(load(batch.rad + i), v_t::set1(by_r));
+			const auto mask = v_t::mask_and(v_t::cmp_ge(r2, v_t::set1(params.eps)), v_t::cmp_lt(r, max_r));
+			const f32 ri = v_t::div(v_t::set1(1.0f), r);
+			const f32 c = v_t::mul(v_t::mul(v_t::set1(params.coef), ri), ri);
+			for (int d = 0; d < physics_dim; d++) {
+				float* acc = batch.accelerations[d] + i;
+				store(acc, v_t::add(load(acc), v_t::mask_zero(mask, v_t::mul(c, v_t::mul(dr[d], ri)))));
+			}
+			return v_t::mask_count(masked ? v_t::mask_and(mask, tail) : mask); // lanes past the tail load zeros and may pass the cutoff
+		}
+
+		YIN_YANG_TARGET_AVX2 static int accumulate_forces8(const force_params_t& params, force_batch_t& batch, int count, const physics_vec_t& by, float by_r) {
+			return accumulate_forces_kernel<simd_avx2_t>(params, batch, count, by, by_r);
+		}
+
+		YIN_YANG_TARGET_AVX512 static int accumulate_forces16(const force_params_t& params, force_batch_t& batch, int count, const physics_vec_t& by, float by_r) {
+			return accumulate_forces_kernel<simd_avx512_t>(params, batch, count, by, by_r);
+		}
+
+		physics_vec_t env_force(const physics_vec_t& pos, const physics_vec_t& vel) {
+			physics_vec_t acc{};
 			for (auto& attractor : attractors) {
-				glm::vec3 dr = pos - attractor.pos;
+				physics_vec_t dr = pos - to_physics_vec(attractor.pos);
 				float r = glm::length(dr);
 				if (r < catch_radius) {
 					return -0.1f * vel;
@@ -2841,18 +3771,18 @@ void main() {
 				acc -= (attractor.GM * ri * ri) * (dr * ri);
 			}
 			for (auto& force : forces) {
-				acc += force.dir * force.mag;
+				acc += to_physics_vec(force.dir) * force.mag;
 			}
 			return acc;
 		}
 		
-		std::tuple<glm::vec3, glm::vec3> integrate_motion(const glm::vec3 r0, const glm::vec3& v0, const glm::vec3& a) {
-			glm::vec3 v1 = v0 + dt_step * a;
-			glm::vec3 r1 = r0 + dt_step * v1;
+		std::tuple<physics_vec_t, physics_vec_t> integrate_motion(const physics_vec_t r0, const physics_vec_t& v0, const physics_vec_t& a) {
+			physics_vec_t v1 = v0 + dt_step * a;
+			physics_vec_t r1 = r0 + dt_step * v1;
 			if (float rr = glm::dot(r1, r1); rr > bounding_r * bounding_r) {
 				r1 *= (bounding_r / std::sqrt(rr));
 
-				glm::vec3 nr1 = r1 * (1.0f / bounding_r);
+				physics_vec_t nr1 = r1 * (1.0f / bounding_r);
 				float proj_v1r1 = glm::dot(v1, nr1);
 				if (proj_v1r1 > eps) {
 					v1 -= nr1 * (1.0f * proj_v1r1);
@@ -2862,13 +3792,7 @@ void main() {
 		}
 
 		void apply_updates() {
-			if (!skip_wait_render) {
-				std::unique_lock lock{render_job_finished_lock};
-				render_job_finished_cond.wait(lock, [&] (){
-					return render_jobs_finished == render_submit_jobs.size();
-				});
-				skip_wait_render = true;
-			}
+			render_group.wait(); // render jobs read particles (helps the pool, so it can't stall if update runs on a worker)
 			std::swap(particles, updated_particles_buffer);
 		}
 
@@ -2890,8 +3814,8 @@ void main() {
 			for (int i = 0; i < count; i++) {
 				particle_t& particle = particles[start + i];
 
-				glm::mat4 mat{particle_r};
-				mat[3] = glm::vec4(particle.pos, 1.0f); // TODO : very ugly
+				glm::mat4 mat{particle_r * particle.size};
+				mat[3] = glm::vec4(to_world_vec(particle.pos), 1.0f); // TODO : very ugly
 				region.mat[i] = mat;
 			}
 		}
@@ -2902,17 +3826,13 @@ void main() {
 			double t0 = glfw::get_time();
 			__submit_to_render(job);
 			job->elapsed = glfw::get_time() - t0;
-
-			std::unique_lock lock{render_job_finished_lock};
-			render_jobs_finished++;
-			render_job_finished_cond.notify_one();
 		}
 
 
 	public:
-		void add_particle(const glm::vec3& pos, const glm::vec3& vel) {
+		void add_particle(const glm::vec3& pos, const glm::vec3& vel, float size = 1.0f) {
 			if (particles.size() < max_particles) {
-				particles.push_back({pos, vel});
+				particles.push_back({to_physics_vec(pos), to_physics_vec(vel), size});
 			}
 		}
 
@@ -2941,6 +3861,13 @@ void main() {
 		int updates_per_frame{};
 
 		bool sync_grid_scale_n_particle_r{};
+
+		int stencil_rings{};
+		bool sphere_stencil{};
+		stencil_t stencil{};
+
+		int64_t pair_tests{};
+		int64_t pair_hits{};
 		
 		unsigned obj_id{};
 
@@ -2952,28 +3879,96 @@ void main() {
 		lofi_stack_alloc_t<glm::mat4> render_buffer_alloc{};
 
 		std::vector<particle_t> updated_particles_buffer{};
-		lofi_stack_alloc_t<particle_t> updated_particles{};
+
+		std::vector<physics_cell_t> particle_cells{}; // current cell of each particle, valid during a substep
+		std::vector<uint32_t> particle_hashes{};
+		std::vector<uint8_t> particle_levels{}; // grid level of each particle, always 0 if hierarchical grid is off
 
 		std::vector<uint32_t> next_particle{};
-		std::vector<lofi_bucket_t> sparse_grid_buffer{};
-		lofi_hashtable_t sparse_grid{};
+		std::vector<sparse_grid_bucket_t> sparse_grid_buffer{};
+		std::vector<lofi_probe_bound_t> sparse_grid_bounds{};
+		sparse_grid_t sparse_grid{};
 
 		std::vector<uint32_t> light_buckets_buffer{};
 		lofi_stack_alloc_t<uint32_t> light_buckets{};
 
+		// telemetry
+		bool telemetry_enabled{};
+		grid_telemetry_t frame_telemetry{};
+		int used_buckets_history[telemetry_history_size] = {};
+		float load_factor_history[telemetry_history_size] = {};
+		int telemetry_history_top{};
+
+		// occupancy filter
+		bool use_occupancy_filter{};
+		uint32_t occupancy_filter_bits_log2{};
+		std::vector<uint64_t> occupancy_filter_words{};
+		lofi_occupancy_filter_t occupancy_filter{};
+
+		int neighbour_lookups{};
+		int filter_rejects{};
+		int filter_false_positives{};
+
+		// compact cells (CSR), cell_offsets are indexed by bucket
+		bool compact_cells{};
+
+		std::vector<uint32_t> cell_offsets{};
+		std::vector<particle_t> compact_particles{};
+		std::vector<uint32_t> compact_ids{};
+
+		// hierarchical sparse grid
+		bool hierarchical_grid{};
+		uint32_t occupied_levels{}; // bit per level, valid during a substep
+		float level_max_sizes[max_grid_levels] = {};
+		int cross_level_pairs{};
+
+		std::vector<physics_vec_t> cross_level_acc{};
+
+		// partitioned sparse grid build
+		bool partitioned_build{};
+
+		std::vector<uint32_t> binned_particles{};
+		std::vector<uint32_t> bin_offsets{};
+		lofi_partition_bins_t sparse_grid_bins{};
+
+		std::vector<uint32_t> overflow_particles_buffer{};
+		lofi_stack_alloc_t<uint32_t> overflow_particles{};
+
+		// incremental sparse grid
+		static constexpr float incremental_grid_max_churn = 0.25f;
+		static constexpr float incremental_grid_max_tombstones = 0.25f;
+
+		bool incremental_grid{};
+		bool grid_valid{};
+		int grid_item_count{};
+		float grid_scale_built{};
+		int grid_tombstones{};
+		int grid_moved{};
+		int grid_rebuilds{};
+
+		std::vector<uint32_t> prev_particle{};
+		std::vector<uint32_t> grid_buckets{};
+		std::vector<physics_cell_t> grid_cells{};
+		std::vector<uint8_t> grid_levels{};
+
+		std::vector<uint32_t> moved_particles_buffer{};
+		lofi_stack_alloc_t<uint32_t> moved_particles{};
+
 		std::vector<std::unique_ptr<update_job_t>> update_jobs{};
 		update_phase_t update_phase{};
+		std::vector<job_if_t*> resident_update_jobs{};
+		phase_barrier_t update_barrier{};
+		job_group_t update_group{};
 
 		std::vector<std::unique_ptr<render_submit_job_t>> render_submit_jobs{};
-		std::mutex render_job_finished_lock{};
-		std::condition_variable render_job_finished_cond{};
-		int render_jobs_finished{};
-		bool skip_wait_render{};
+		std::vector<job_if_t*> render_submit_job_ptrs{};
+		job_group_t render_group{};
 	};
 
 
 	struct level_system_settings_t {
 		int balls_count{};
+		float max_ball_size{1.0f}; // sizes are log-uniform in [1, max_ball_size]
 	};
 
 	class level_system_t : public system_if_t {
@@ -2983,7 +3978,8 @@ void main() {
 				glm::vec3 color = color_gen.gen();
 				glm::vec3 pos = glm::vec3{coord_gen.gen(), coord_gen.gen(), coord_gen.gen()};
 				glm::vec3 vel{};
-				physics->add_particle(pos, vel);
+				float size = std::exp2(size_gen.gen() * std::log2(max_ball_size));
+				physics->add_particle(pos, vel, size);
 			}
 			balls_count += count;
 		}
@@ -3084,6 +4080,8 @@ void main() {
 				if (ImGui::Button("spawn balls")) {
 					spawn_balls(balls_count_gui);
 				}
+				ImGui::SetNextItemWidth(100.0f);
+				ImGui::DragFloat("max ball size", &max_ball_size, 0.1f, 1.0f, 100.0f, "%.1f", ImGuiSliderFlags_AlwaysClamp);
 				ImGui::Checkbox("enable flying", &flying);
 
 				entity_t basic_pass{get_ctx(), basic_pass_handle};
@@ -3103,13 +4101,14 @@ void main() {
 				});
 				imgui_system->register_callback([&](){
 					return level_control_gui();
-				});
+				}, {.writes = {"level", "physics", "components"}});
 			}
 		}
 
 	public:
 		level_system_t(engine_ctx_t* ctx, const level_system_settings_t& settings)
 			: system_if_t(ctx) {
+			max_ball_size = settings.max_ball_size;
 			spawn_balls(settings.balls_count);
 			create_attractors();
 			create_passes();
@@ -3128,13 +4127,19 @@ void main() {
 
 		void update() {}
 
+		task_access_t update_access() const {
+			return {.writes = {"level"}};
+		}
+
 	private:
 		hsv_to_rgb_color_gen_t color_gen{42};
 		float_gen_t coord_gen{42, -30.0f, +30.0f};
+		float_gen_t size_gen{43, 0.0f, 1.0f};
 		handle_t basic_pass_handle{};
 		handle_t imgui_pass_handle{};
 		int balls_count{};
 		int balls_count_gui{};
+		float max_ball_size{1.0f};
 		bool flying{};
 
 		resource_ptr_t<texture_t> framebuffer_texture{};
@@ -3156,7 +4161,12 @@ void main() {
 			constexpr int tex_height = 720;
 			constexpr int max_balls = 1 << 18;
 
-			thread_pool = std::make_shared<thread_pool_system_t>(ctx, 24);
+			// worker count from the cpu topology, master thread keeps its own core
+			thread_pool_settings_t thread_pool_settings{
+				.pin_workers = false,
+				.reserve_master_core = true
+			};
+			thread_pool = std::make_shared<thread_pool_system_t>(ctx, thread_pool_settings);
 			ctx->add_system("thread_pool", thread_pool);
 
 			window_system = std::make_shared<window_system_t>(ctx, window_width, window_height);
@@ -3201,6 +4211,8 @@ void main() {
 
 			sync_component_system = std::make_shared<sync_component_system_t>(ctx);
 			ctx->add_system("sync_component", sync_component_system);
+
+			build_frame_graph();
 		}
 
 		~mainloop_t() {
@@ -3239,38 +4251,97 @@ void main() {
 
 		virtual void execute() override {
 			auto& window = window_system->get_window();
-			auto& physics = *physics_system;
-			auto& basic_renderer = *basic_renderer_system;
-			auto& imgui = *imgui_system;
-			auto& sync = *sync_component_system;
-			auto& timer = *timer_system;
-			auto& level = *level_system;
 
 			glfwSwapInterval(0);
 
 			double t0 = glfwGetTime();
 			while (!window.should_close()) {
 				double t1 = glfwGetTime();
-				float dt = t1 - t0;
+				frame_dt = t1 - t0;
 				t0 = t1;
 
 				window.swap_buffers();
 
 				glfw::poll_events();
 
-				basic_renderer.render_prev_frame();
+				frame_graph.execute(*thread_pool, parallel_frame);
+			}
+		}
+
+	private:
+		// systems are added in the order they used to be called in, dependencies come from declared accesses
+		void build_frame_graph() {
+			auto& physics = *physics_system;
+			auto& basic_renderer = *basic_renderer_system;
+			auto& imgui = *imgui_system;
+			auto& sync = *sync_component_system;
+			auto& timer = *timer_system;
+			auto& level = *level_system;
 
+			frame_graph.add_task("render prev frame", basic_renderer.render_prev_frame_access(), [&] () {
+				basic_renderer.render_prev_frame();
+			});
+			frame_graph.add_task("imgui", imgui.update_access(), [&] () {
 				imgui.update();
-				physics.update(dt);
-				timer.update(dt);
+			});
+			// physics is a main thread task, not because of GL: its phase barrier needs master + a resident job on every other worker,
+			// a pool worker acting as master would leave one resident job waiting for the rest of the graph
+			// main thread loses no concurrency: physics runs after imgui (callbacks write physics) which runs after render prev frame (GL)
+			// pool runs the update & render submit jobs of physics, timer, level & sync
+			frame_graph.add_task("physics", physics.update_access(), [&] () {
+				physics.update(frame_dt);
+			});
+			frame_graph.add_task("timer", timer.update_access(), [&] () {
+				timer.update(frame_dt);
+			});
+			frame_graph.add_task("level", level.update_access(), [&] () {
 				level.update();
+			});
+			frame_graph.add_task("sync", sync.update_access(), [&] () {
 				sync.update();
-
+			});
+			frame_graph.add_task("finish next frame", basic_renderer.finish_next_frame_access(), [&] () {
 				basic_renderer.finish_next_frame();
+			});
+
+			// ui reads stats of the previous frame, they are updated after the graph is done
+			imgui.register_callback([&] () {
+				return draw_frame_graph_ui();
+			});
+		}
+
+		bool draw_frame_graph_ui() {
+			ImGui::SetNextWindowSize(ImVec2{256, 256}, ImGuiCond_Once);
+			if (ImGui::Begin("frame graph")) {
+				const auto& stats = frame_graph.get_stats();
+
+				const auto& topology = thread_pool->get_topology();
+				ImGui::Text("workers: %d (%s), cores: %d, threads: %d, numa nodes: %d", thread_pool->worker_count(),
+					thread_pool->get_worker_cpus().empty() ? "unpinned" : "pinned", topology.core_count(), topology.logical_count(), topology.node_count);
+
+				ImGui::Checkbox("parallel", &parallel_frame);
+				ImGui::Text("frame: %.3f ms, critical path: %.3f ms", stats.frame_time, stats.critical_path_time);
+
+				std::string critical_path;
+				for (int id : stats.critical_path) {
+					if (!critical_path.empty()) {
+						critical_path += " -> ";
+					}
+					critical_path += frame_graph.get_task(id).name;
+				}
+				ImGui::TextWrapped("critical path: %s", critical_path.c_str());
+
+				for (int id = 0; id < frame_graph.task_count() && id < stats.start.size(); id++) {
+					const auto& task = frame_graph.get_task(id);
+					const bool critical = std::find(stats.critical_path.begin(), stats.critical_path.end(), id) != stats.critical_path.end();
+					ImGui::Text("%c %-18s %s %7.3f .. %7.3f ms", critical ? '*' : ' ', task.name.c_str(), task.access.main_thread ? "main" : "pool",
+						stats.start[id], stats.stop[id]);
+				}
 			}
+			ImGui::End();
+			return true;
 		}
 
-	private:
 		engine_ctx_t* ctx{};
 		std::shared_ptr<thread_pool_system_t> thread_pool;
 		std::shared_ptr<window_system_t> window_system;
@@ -3281,6 +4352,10 @@ void main() {
 		std::shared_ptr<timer_system_t> timer_system;
 		std::shared_ptr<level_system_t> level_system;
 		std::shared_ptr<sync_component_system_t> sync_component_system;
+
+		task_graph_t frame_graph{};
+		float frame_dt{};
+		bool parallel_frame{true};
 	};
 
 	// test class
@@ -3305,8 +4380,9 @@ void main() {
 
 
 // some pile of shit (tests)
+template<class hasher_t = sparse_cell_hasher_t>
 void test_sparse_grid_hash() {
-	auto hash = sparse_cell_hasher_t{};
+	auto hash = hasher_t{};
 
 	std::unordered_map<std::uint32_t, std::uint32_t> hash_count;
 	int_gen_t x(41, -100000000, 100000000);
@@ -3336,6 +4412,88 @@ void test_sparse_grid_hash() {
 	std::cout << "unique_counts: " << hash_count_count.size() << "\n";
 }
 
+// batch hashing: checks batch == scalar, compares throughput against scalar hashers, then distribution
+void test_sparse_grid_batch_hash() {
+	using clock_t = std::chrono::high_resolution_clock;
+
+	const int cell_count = 1 << 22;
+	const int repeats = 16;
+
+	std::vector<sparse_cell_t> cells(cell_count);
+	std::vector<int> xs(cell_count), ys(cell_count), zs(cell_count);
+	int_gen_t x(41, -100000000, 100000000);
+	int_gen_t y(42, -100000000, 100000000);
+	int_gen_t z(43, -100000000, 100000000);
+	for (int i = 0; i < cell_count; i++) {
+		cells[i] = sparse_cell_t{x.gen(), y.gen(), z.gen()};
+		xs[i] = cells[i].x;
+		ys[i] = cells[i].y;
+		zs[i] = cells[i].z;
+	}
+
+	std::vector<uint32_t> scalar_hashes(cell_count);
+	std::vector<uint32_t> batch_hashes(cell_count);
+	std::vector<uint32_t> soa_hashes(cell_count);
+	for (int i = 0; i < cell_count; i++) {
+		scalar_hashes[i] = sparse_cell_mix_hasher_t{}(cells[i]);
+	}
+	sparse_cell_hash_many(cells.data(), cell_count, batch_hashes.data());
+	sparse_cell_hash_many(xs.data(), ys.data(), zs.data(), cell_count, soa_hashes.data());
+
+	// odd counts exercise the scalar tail
+	std::vector<uint32_t> tail_hashes(cell_count);
+	sparse_cell_hash_many(cells.data() + 3, 1021, tail_hashes.data());
+
+	bool valid = scalar_hashes == batch_hashes && scalar_hashes == soa_hashes
+		&& std::equal(tail_hashes.begin(), tail_hashes.begin() + 1021, scalar_hashes.begin() + 3);
+	std::cout << "batch hash: " << (valid ? "valid" : "invalid") << "\n";
+
+	auto measure = [&] (const char* name, auto&& func) {
+		uint32_t checksum = 0;
+		auto start = clock_t::now();
+		for (int r = 0; r < repeats; r++) {
+			checksum += func();
+		}
+		auto stop = clock_t::now();
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count() / ((double)cell_count * repeats);
+		std::cout << name << ": " << ns << " ns/cell (" << checksum << ")\n";
+	};
+
+	measure("scalar h32", [&] () {
+		uint32_t sum = 0;
+		for (int i = 0; i < cell_count; i++) {
+			sum += sparse_cell_hasher_t::hcell_scalar(cells[i]);
+		}
+		return sum;
+	});
+	if (simd_cpu_level() >= simd_level_t::Sse42) {
+		measure("scalar crc32", [&] () {
+			uint32_t sum = 0;
+			for (int i = 0; i < cell_count; i++) {
+				sum += sparse_cell_hasher_t::hcell_crc32(cells[i]);
+			}
+			return sum;
+		});
+	}
+	measure("scalar mix", [&] () {
+		uint32_t sum = 0;
+		for (int i = 0; i < cell_count; i++) {
+			sum += sparse_cell_mix_hasher_t{}(cells[i]);
+		}
+		return sum;
+	});
+	measure("batch mix aos", [&] () {
+		sparse_cell_hash_many(cells.data(), cell_count, batch_hashes.data());
+		return batch_hashes[cell_count / 2];
+	});
+	measure("batch mix soa", [&] () {
+		sparse_cell_hash_many(xs.data(), ys.data(), zs.data(), cell_count, soa_hashes.data());
+		return soa_hashes[cell_count / 2];
+	});
+
+	test_sparse_grid_hash<sparse_cell_mix_hasher_t>();
+}
+
 void test_thread_pool1() {
 	struct some_job_t : public job_if_t {
 		some_job_t() = default;
@@ -3422,86 +4580,242 @@ void test_thread_pool2() {
 	}
 }
 
-void test_callback() {
-	struct some_struct_t {
-		static void callback(some_struct_t* ctx, int num) {
-			auto* this_ptr = (some_struct_t*)ctx;
-			std::cout << this_ptr->term + num << "\n";
+// jobs pushing & waiting on nested jobs: waiting worker must execute queued jobs instead of blocking
+void test_thread_pool3() {
+	struct leaf_job_t : public job_if_t {
+		void execute() override {
+			for (int i = 0; i < 1000; i++) {
+				result += i;
+			}
 		}
 
-		int term{};
+		std::int64_t result{};
 	};
 
-	some_struct_t whatever{5};
-	callback_t<void(int)> cb{whatever, some_struct_t::callback};
-	cb(5);
-}
+	struct job_t : public job_if_t {
+		job_t(thread_pool_t* _pool)
+			: pool{_pool}
+		{}
 
+		void execute() override {
+			leaf_job_t leaves[8];
+			for (auto& leaf : leaves) {
+				pool->push_job(&leaf);
+			}
+			for (auto& leaf : leaves) {
+				leaf.wait();
+				result += leaf.result;
+			}
+		}
 
-template<int size>
-struct load_mask_epi32 {
-	constexpr load_mask_epi32() = default;
+		thread_pool_t* pool{};
+		std::int64_t result{};
+	};
 
-	constexpr load_mask_epi32(int load_count) {
-		for (int i = 0; i < load_count; i++) {
-			mask[i] = -1;
-		}
+	thread_pool_t pool(4);
+	std::vector<std::unique_ptr<job_t>> jobs;
+	for (int i = 0; i < 64; i++) {
+		jobs.push_back(std::make_unique<job_t>(&pool));
 	}
 
-	int mask[size] = {};
-};
+	for (auto& job : jobs) {
+		pool.push_job(job.get());
+	}
 
-template<class T>
-struct alignas(32) load_mask_table_epi32 {
-	static constexpr int size = sizeof(T) / 4;
+	bool passed = true;
+	for (auto& job : jobs) {
+		job->wait();
+		passed &= job->result == 8 * 499500;
+	}
+	std::cout << "nested jobs: " << (passed ? "passed" : "failed") << "\n";
+}
 
-	constexpr load_mask_table_epi32() {
-		for (int i = 0; i < size; i++) {
-			mask[i] = load_mask_epi32<size>(i);
-		}
+// producers push sequences in bulk, consumers pop in bulk: every value must be popped exactly once
+void test_mpmc_ring() {
+	constexpr int producers = 4;
+	constexpr int consumers = 4;
+	constexpr int values_per_producer = 1 << 18;
+
+	mpmc_ring_t<uint32_t> ring(6); // small ring so producers run into a full ring
+	std::vector<std::atomic<int>> popped(producers * values_per_producer);
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.push_back(std::thread([&, p] () {
+			uint32_t values[13];
+			for (int i = 0; i < values_per_producer; i += std::size(values)) {
+				const int count = std::min<int>(std::size(values), values_per_producer - i);
+				for (int k = 0; k < count; k++) {
+					values[k] = p * values_per_producer + i + k;
+				}
+				for (int pushed = 0; pushed < count; ) {
+					const int curr = ring.push_bulk(values + pushed, count - pushed);
+					if (curr == 0) {
+						std::this_thread::yield();
+					}
+					pushed += curr;
+				}
+			}
+		}));
 	}
 
-	constexpr auto operator[] (int i) const {
-		return *(const T*)&mask[i];
+	std::atomic<int> remaining{producers * values_per_producer};
+	for (int c = 0; c < consumers; c++) {
+		threads.push_back(std::thread([&] () {
+			uint32_t values[7];
+			while (remaining.load(std::memory_order_relaxed) > 0) {
+				const int count = ring.pop_bulk(values, std::size(values));
+				if (count == 0) {
+					std::this_thread::yield();
+					continue;
+				}
+				for (int k = 0; k < count; k++) {
+					popped[values[k]].fetch_add(1, std::memory_order_relaxed);
+				}
+				remaining.fetch_sub(count, std::memory_order_relaxed);
+			}
+		}));
 	}
 
-	load_mask_epi32<size> mask[size];
-};
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	bool passed = true;
+	for (auto& count : popped) {
+		passed &= count.load(std::memory_order_relaxed) == 1;
+	}
+	std::cout << "mpmc ring: " << (passed ? "passed" : "failed") << "\n";
+}
+
+void test_parallel_primitives() {
+	thread_pool_t pool(8);
+
+	bool passed = true;
+	for (int count : {0, 1, 255, 256, 1000, 100000}) {
+		for (int grain : {0, 1, 7, 1024}) {
+			std::vector<int> values(count);
+			pool.parallel_for(0, count, grain, [&] (int start, int stop) {
+				for (int i = start; i < stop; i++) {
+					values[i] = i % 13;
+				}
+			});
 
-inline constexpr load_mask_table_epi32<__m256i> table{};
+			std::int64_t expected_sum = 0;
+			for (int i = 0; i < count; i++) {
+				passed &= values[i] == i % 13;
+				expected_sum += values[i];
+			}
+
+			std::int64_t sum = pool.parallel_reduce(0, count, grain, std::int64_t{}, [&] (int start, int stop) {
+				std::int64_t part = 0;
+				for (int i = start; i < stop; i++) {
+					part += values[i];
+				}
+				return part;
+			}, std::plus<std::int64_t>{});
+			passed &= sum == expected_sum;
+
+			std::vector<std::int64_t> offsets(count);
+			std::int64_t total = pool.parallel_exclusive_scan(0, count, grain, std::int64_t{5}, [&] (int i) {
+				return (std::int64_t)values[i];
+			}, [&] (int i, std::int64_t offset) {
+				offsets[i] = offset;
+			});
+			passed &= total == expected_sum + 5;
 
-void add(float a[], float b[], int len) {
-	int i = 0;
-	for (; len >= 8; len -= 8, i += 8) {
-		const __m256 batch_a = _mm256_loadu_ps(a + i);
-		const __m256 batch_b = _mm256_loadu_ps(b + i);
-		_mm256_storeu_ps(a + i, _mm256_add_ps(batch_a, batch_b));
+			std::int64_t offset = 5;
+			for (int i = 0; i < count; i++) {
+				passed &= offsets[i] == offset;
+				offset += values[i];
+			}
+		}
 	}
-	if (len) {
-		const __m256i mask = table[len];
-		const __m256 batch_a = _mm256_maskload_ps(a + i, mask);
-		const __m256 batch_b = _mm256_maskload_ps(b + i, mask);
-		_mm256_maskstore_ps(a + i, mask, _mm256_add_ps(batch_a, batch_b));
+	std::cout << "parallel primitives: " << (passed ? "passed" : "failed") << "\n";
+}
+
+// tasks touching the same data must run in program order, main thread tasks must stay on the calling thread
+void test_task_graph() {
+	thread_pool_t pool(4);
+	task_graph_t graph;
+
+	std::atomic<int> clock{};
+	int order[6] = {};
+	bool main_thread_ok = true;
+	const auto main_id = std::this_thread::get_id();
+
+	auto task = [&] (int id, bool main_thread) {
+		return [&, id, main_thread] () {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			order[id] = clock.fetch_add(1);
+			if (main_thread) {
+				main_thread_ok &= std::this_thread::get_id() == main_id;
+			}
+		};
+	};
+
+	graph.add_task("a", {.writes = {"x"}}, task(0, false));
+	graph.add_task("b", {.reads = {"x"}, .main_thread = true}, task(1, true));
+	graph.add_task("c", {.reads = {"x"}}, task(2, false));
+	graph.add_task("d", {.writes = {"y"}}, task(3, false));
+	graph.add_task("e", {.writes = {"x"}, .main_thread = true}, task(4, true));
+	graph.add_task("f", {.reads = {"x", "y"}}, task(5, false));
+
+	bool passed = true;
+	for (int frame = 0; frame < 100; frame++) {
+		clock = 0;
+		graph.execute(pool, frame % 2 == 0);
+		passed &= order[0] < order[1] && order[0] < order[2];
+		passed &= order[1] < order[4] && order[2] < order[4];
+		passed &= order[4] < order[5] && order[3] < order[5];
+
+		const auto& stats = graph.get_stats();
+		passed &= !stats.critical_path.empty() && stats.critical_path.back() == 5;
+		passed &= stats.critical_path_time <= stats.frame_time + 1e-3;
 	}
+	passed &= main_thread_ok;
+	std::cout << "task graph: " << (passed ? "passed" : "failed") << "\n";
+}
+
+void test_callback() {
+	struct some_struct_t {
+		static void callback(some_struct_t* ctx, int num) {
+			auto* this_ptr = (some_struct_t*)ctx;
+			std::cout << this_ptr->term + num << "\n";
+		}
+
+		int term{};
+	};
+
+	some_struct_t whatever{5};
+	callback_t<void(int)> cb{whatever, some_struct_t::callback};
+	cb(5);
 }
 
 
 int main() {
 	//test_octotree_stuff();
 	//test_sparse_grid_hash();
+	//test_sparse_grid_batch_hash();
 	//test_sparse_grid();
 	//test_thread_pool1();
 	//test_thread_pool2();
+	//test_thread_pool3();
+	//test_mpmc_ring();
+	//test_parallel_primitives();
+	//test_task_graph();
 	//test_callback();
 
 	float a[] = {1, 2, 3, 4, 5, 6, 7};
 	float b[] = {1, 2, 3, 4, 5, 6, 7};
-	add(a, b, 7);
+	simd_add(a, b, 7);
 	for (int i = 0; i < 7; i++) {
 		std::cout << a[i] << " ";
 	}
 	std::cout << "\n";
 
+	std::cout << "simd: " << simd_level_name(simd_level()) << " (cpu: " << simd_level_name(simd_cpu_level()) << ")\n";
+
 	engine_t engine;
 	engine.execute();
 	return 0;